@@ -0,0 +1,263 @@
+/***********************************************************************
+ *
+ * Filename: assimp.cpp
+ *
+ * Description: Imports any mesh format assimp can read.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#include "assimp.hpp"
+#include "parallel.hpp"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <unordered_map>
+#include <cmath>
+
+using namespace feather;
+
+namespace
+{
+
+    // the positions and normals are copied as whole arrays
+    static_assert(sizeof(aiVector3D) == sizeof(FVertex3D), "aiVector3D must be 3 floats, assimp can't be built with double precision");
+
+    // the bits of a value so equal values can be found with a hash
+    template <unsigned int N>
+    struct value_key_t {
+        uint32_t bits[N];
+        bool operator==(const value_key_t& other) const { return !memcmp(bits, other.bits, sizeof(bits)); };
+    };
+
+    template <unsigned int N>
+    struct key_hash {
+        size_t operator()(const value_key_t<N>& key) const {
+            size_t h = 0;
+            for(unsigned int i=0; i < N; i++)
+                h = h*0x9e3779b1 + key.bits[i];
+            return h;
+        };
+    };
+
+    // moves the first of each value to the front of the array and returns
+    // the new index of every old one
+    template <typename T>
+    std::vector<uint32_t> join(std::vector<T>& values)
+    {
+        const unsigned int N = sizeof(T)/sizeof(uint32_t);
+        std::unordered_map<value_key_t<N>,uint32_t,key_hash<N>> index;
+        index.reserve(values.size());
+        std::vector<uint32_t> remap(values.size());
+
+        uint32_t count = 0;
+        for(size_t i=0; i < values.size(); i++) {
+            value_key_t<N> key;
+            memcpy(key.bits, &values[i], sizeof(T));
+            auto r = index.insert(std::make_pair(key, count));
+            if(r.second)
+                values[count++] = values[i];
+            remap[i] = r.first->second;
+        }
+
+        values.resize(count);
+        return remap;
+    }
+
+    inline void remap(size_t size, const std::vector<uint32_t>& index, FUInt& i)
+    {
+        if(i < size)
+            i = index[i];
+    }
+
+    // copies an aiMesh into the mesh, face points use the same index for
+    // every attribute the mesh has and 0 for the ones it doesn't
+    void get_mesh(const aiMesh& in, FMesh& mesh)
+    {
+        unsigned int n = in.mNumVertices;
+        bool st = in.HasTextureCoords(0);
+        bool vn = in.HasNormals();
+
+        mesh.v.resize(n);
+        if(n)
+            memcpy(reinterpret_cast<float*>(mesh.v.data()), in.mVertices, n*sizeof(FVertex3D));
+
+        mesh.vn.resize(vn ? n : 0);
+        if(vn && n)
+            memcpy(reinterpret_cast<float*>(mesh.vn.data()), in.mNormals, n*sizeof(FVertex3D));
+
+        // assimp keeps 3 components for every texture coord
+        mesh.st.resize(st ? n : 0);
+        if(st) {
+            const aiVector3D* uv = in.mTextureCoords[0];
+            for(unsigned int i=0; i < n; i++)
+                mesh.st[i] = FTextureCoord(uv[i].x, uv[i].y);
+        }
+
+        unsigned int faces = 0;
+        for(unsigned int i=0; i < in.mNumFaces; i++)
+            if(in.mFaces[i].mNumIndices >= 3)
+                faces++;
+
+        mesh.f.resize(faces);
+        unsigned int f = 0;
+        for(unsigned int i=0; i < in.mNumFaces; i++) {
+            const aiFace& face = in.mFaces[i];
+            if(face.mNumIndices < 3)
+                continue;
+            FFace& out = mesh.f[f++];
+            out.resize(face.mNumIndices);
+            for(unsigned int j=0; j < face.mNumIndices; j++) {
+                unsigned int index = face.mIndices[j];
+                out[j] = FFacePoint(index, st ? index : 0, vn ? index : 0);
+            }
+        }
+    }
+
+    std::string mesh_name(const aiMesh& mesh, std::string filename, unsigned int index)
+    {
+        if(mesh.mName.length)
+            return mesh.mName.C_Str();
+        std::stringstream ss;
+        ss << io::obj_format::default_name(filename) << index;
+        return ss.str();
+    }
+
+} // namespace
+
+
+status io::assimp_format::read(std::string filename, obj_format::mesh_sink_t& sink, unsigned int steps, unsigned int threads)
+{
+    // assimp's own post processing would run each step over every mesh
+    // on this thread, the steps are done below instead
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(filename, 0);
+    if(!scene) {
+        std::cout << "error loading \"" << filename << "\": " << importer.GetErrorString() << std::endl;
+        return status(FAILED,"assimp could not read the file");
+    }
+
+    // the nodes are made one at a time, only the mesh data is done in parallel
+    std::vector<FMesh*> meshes(scene->mNumMeshes, nullptr);
+    for(unsigned int i=0; i < scene->mNumMeshes; i++) {
+        const aiMesh& mesh = *scene->mMeshes[i];
+        uint32_t n = mesh.mNumVertices;
+        obj_format::object_size_t size = { n, mesh.HasTextureCoords(0) ? n : 0, mesh.HasNormals() ? n : 0, mesh.mNumFaces };
+        sink.object(i, mesh_name(mesh, filename, i), size);
+    }
+
+    for(unsigned int i=0; i < scene->mNumMeshes; i++)
+        meshes[i] = sink.mesh(i);
+
+    parallel_for(meshes.size(), threads, [&] (unsigned int i) {
+        if(!meshes[i])
+            return;
+        FMesh& mesh = *meshes[i];
+        get_mesh(*scene->mMeshes[i], mesh);
+        if(steps & Triangulate)
+            triangulate(mesh);
+        if(steps & JoinVertices)
+            join_vertices(mesh);
+        if(steps & Normals)
+            generate_normals(mesh);
+    });
+
+    return status();
+}
+
+void io::assimp_format::triangulate(FMesh& mesh)
+{
+    size_t faces = 0;
+    for(auto& f : mesh.f)
+        faces += f.size() > 3 ? f.size()-2 : 1;
+
+    if(faces == mesh.f.size())
+        return;
+
+    std::vector<FFace> tris;
+    tris.reserve(faces);
+    for(auto& f : mesh.f) {
+        if(f.size() <= 3) {
+            tris.push_back(std::move(f));
+            continue;
+        }
+        for(size_t i=1; i+1 < f.size(); i++)
+            tris.push_back(FFace{ f[0], f[i], f[i+1] });
+    }
+
+    mesh.f.swap(tris);
+}
+
+void io::assimp_format::join_vertices(FMesh& mesh)
+{
+    size_t v = mesh.v.size();
+    size_t st = mesh.st.size();
+    size_t vn = mesh.vn.size();
+
+    std::vector<uint32_t> vindex = join(mesh.v);
+    std::vector<uint32_t> stindex = join(mesh.st);
+    std::vector<uint32_t> vnindex = join(mesh.vn);
+
+    for(auto& f : mesh.f) {
+        for(auto& fp : f) {
+            remap(v, vindex, fp.v);
+            remap(st, stindex, fp.vt);
+            remap(vn, vnindex, fp.vn);
+        }
+    }
+}
+
+void io::assimp_format::generate_normals(FMesh& mesh)
+{
+    if(!mesh.vn.empty() || mesh.v.empty())
+        return;
+
+    // each face adds it's area weighted normal to it's vertices
+    mesh.vn.assign(mesh.v.size(), FVertex3D(0,0,0));
+    for(auto& f : mesh.f) {
+        float x=0, y=0, z=0;
+        for(size_t i=0; i < f.size(); i++) {
+            if(f[i].v >= mesh.v.size() || f[(i+1)%f.size()].v >= mesh.v.size())
+                continue;
+            const FVertex3D& a = mesh.v[f[i].v];
+            const FVertex3D& b = mesh.v[f[(i+1)%f.size()].v];
+            x += (a.y - b.y) * (a.z + b.z);
+            y += (a.z - b.z) * (a.x + b.x);
+            z += (a.x - b.x) * (a.y + b.y);
+        }
+        for(auto& fp : f) {
+            if(fp.v >= mesh.v.size())
+                continue;
+            FVertex3D& n = mesh.vn[fp.v];
+            n.x += x;
+            n.y += y;
+            n.z += z;
+        }
+    }
+
+    for(auto& n : mesh.vn) {
+        float length = std::sqrt(n.x*n.x + n.y*n.y + n.z*n.z);
+        if(length > 0) {
+            n.x /= length;
+            n.y /= length;
+            n.z /= length;
+        }
+    }
+
+    for(auto& f : mesh.f)
+        for(auto& fp : f)
+            fp.vn = fp.v;
+}
@@ -0,0 +1,71 @@
+/***********************************************************************
+ *
+ * Filename: assimp.hpp
+ *
+ * Description: Imports any mesh format assimp can read.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#ifndef ASSIMP_HPP
+#define ASSIMP_HPP
+
+#include <feather/types.hpp>
+#include <feather/deps.hpp>
+#include <feather/status.hpp>
+#include "obj.hpp"
+
+namespace io
+{
+
+/*
+ * ASSIMP IMPORT
+ *
+ * Assimp reads the file (fbx, gltf, dae, stl, 3ds, ...) without any of
+ * it's own post processing, assimp runs each step over every mesh in the
+ * scene one after the other. Each aiMesh is copied into the mesh the sink
+ * gives for it, the positions and normals are copied as whole arrays, and
+ * then the post processing steps below are run on the meshes in parallel.
+ *
+ * Assimp meshes share one index for every attribute so the face points
+ * start out with v, vt and vn all the same. Points and lines are skipped.
+ */
+    namespace assimp_format
+    {
+
+        enum Steps {
+            Triangulate=1,      // split faces with more than 3 points into fans
+            JoinVertices=2,     // merge positions, coords and normals that are the same
+            Normals=4,          // make smooth normals for meshes that don't have any
+            AllSteps=7
+        };
+
+        // reads every mesh in the file into the sink, the object sizes are
+        // the mesh sizes before post processing. The meshes are processed on
+        // up to threads workers, 0 uses every core.
+        feather::status read(std::string filename, obj_format::mesh_sink_t& sink, unsigned int steps=AllSteps, unsigned int threads=0);
+
+        // the post processing steps, these work on any mesh
+        void triangulate(feather::FMesh& mesh);
+        void join_vertices(feather::FMesh& mesh);
+        void generate_normals(feather::FMesh& mesh);
+
+    } // namespace assimp_format
+
+} // namespace io
+
+#endif
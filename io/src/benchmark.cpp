@@ -0,0 +1,338 @@
+/***********************************************************************
+ *
+ * Filename: benchmark.cpp
+ *
+ * Description: Times the import and export paths on generated meshes.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#include "benchmark.hpp"
+#include "io.hpp"
+#include <feather/plugin.hpp>
+#include <sys/resource.h>
+#include <malloc.h>
+#include <chrono>
+#include <iomanip>
+#include <cmath>
+
+using namespace feather;
+using namespace io::benchmark;
+
+namespace
+{
+
+    const uint64_t sizes[] = { 1000, 10000, 100000, 1000000, 10000000, 50000000 };
+
+    // the camera path is the same size every run
+    const unsigned int cameras = 100;
+    const int frames = 1000;
+
+    // bytes the heap is holding, allocations counts aren't kept by malloc
+    // so the growth in bytes is used instead
+    uint64_t heap_size()
+    {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        struct mallinfo2 m = mallinfo2();
+        return m.uordblks + m.hblkhd;
+#elif defined(__GLIBC__)
+        struct mallinfo m = mallinfo();
+        return uint64_t(unsigned(m.uordblks)) + uint64_t(unsigned(m.hblkhd));
+#else
+        return 0;
+#endif
+    }
+
+    long peak_rss()
+    {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    uint64_t file_size(std::string filename)
+    {
+        std::ifstream file(filename.c_str(), std::ios::in|std::ios::binary|std::ios::ate);
+        return file.is_open() ? uint64_t(file.tellg()) : 0;
+    }
+
+    // fn returns true if what it made checks out and sets the file it used
+    template <typename Function>
+    result_t measure(std::string path, uint64_t elements, Function fn)
+    {
+        result_t result;
+        result.path = path;
+        result.elements = elements;
+
+        std::string filename;
+        uint64_t heap = heap_size();
+        auto start = std::chrono::steady_clock::now();
+        result.verified = fn(filename);
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.heap = (double(heap_size()) - double(heap)) / std::max<uint64_t>(elements,1);
+        result.peak_rss = peak_rss();
+        result.bytes = file_size(filename);
+
+        std::cout << "benchmark " << path << " " << elements << (result.verified ? " done\n" : " FAILED\n");
+        return result;
+    }
+
+    // exact for the feather path, the other formats only check the counts
+    double checksum(const FMesh& mesh)
+    {
+        double sum = 0;
+        for(auto& v : mesh.v)
+            sum += v.x + 2*v.y + 3*v.z;
+        for(auto& f : mesh.f)
+            for(auto& fp : f)
+                sum += fp.v + fp.vt + fp.vn;
+        return sum;
+    }
+
+    std::string file_path(std::string directory, uint64_t faces, std::string extension)
+    {
+        std::stringstream ss;
+        ss << directory << "/benchmark_" << faces << "." << extension;
+        return ss.str();
+    }
+
+    // The feather and camera paths need the scene to themselves. The
+    // scene is saved before they run and opened again when this goes out
+    // of scope, so a path that returns early doesn't lose it.
+    class scene_backup_t
+    {
+        public:
+            scene_backup_t(std::string directory) : _filename(directory + "/benchmark_scene.feather"), _saved(false) { };
+            ~scene_backup_t() { restore(); };
+
+            bool save() {
+                _saved = io::feather_format::save(_filename);
+                return _saved;
+            };
+
+            void restore() {
+                if(!_saved)
+                    return;
+                _saved = false;
+                if(!io::feather_format::open(_filename))
+                    std::cout << "benchmark could not restore the scene from \"" << _filename << "\"\n";
+                std::remove(_filename.c_str());
+            };
+
+        private:
+            std::string _filename;
+            bool _saved;
+    };
+
+} // namespace
+
+
+void io::benchmark::make_grid(uint64_t faces, FMesh& mesh)
+{
+    uint32_t side = std::ceil(std::sqrt(double(faces)));
+    uint32_t row = side + 1;
+
+    mesh.v.resize(uint64_t(row)*row);
+    mesh.st.resize(mesh.v.size());
+    mesh.vn.resize(mesh.v.size());
+
+    // a gentle wave so the values don't all print the same
+    for(uint32_t y=0; y < row; y++) {
+        for(uint32_t x=0; x < row; x++) {
+            uint64_t i = uint64_t(y)*row + x;
+            float dx = 0.1f * std::cos(x*0.1f) * std::cos(y*0.1f);
+            float dy = -0.1f * std::sin(x*0.1f) * std::sin(y*0.1f);
+            float length = std::sqrt(dx*dx + dy*dy + 1.0f);
+            mesh.v[i] = FVertex3D(x, y, std::sin(x*0.1f) * std::cos(y*0.1f));
+            mesh.st[i] = FTextureCoord(float(x)/side, float(y)/side);
+            mesh.vn[i] = FVertex3D(-dx/length, -dy/length, 1.0f/length);
+        }
+    }
+
+    mesh.f.resize(uint64_t(side)*side);
+    for(uint32_t y=0; y < side; y++) {
+        for(uint32_t x=0; x < side; x++) {
+            uint32_t i = y*row + x;
+            uint32_t corner[4] = { i, i+1, i+row+1, i+row };
+            FFace& face = mesh.f[uint64_t(y)*side + x];
+            face.resize(4);
+            for(unsigned int c=0; c < 4; c++)
+                face[c] = FFacePoint(corner[c], corner[c], corner[c]);
+        }
+    }
+}
+
+status io::benchmark::run(std::string directory, uint64_t max_faces, std::vector<result_t>& results)
+{
+    scene_backup_t scene(directory);
+    if(!scene.save())
+        return status(FAILED,"could not save the scene before the benchmark");
+
+    for(uint64_t size : sizes) {
+        if(size > max_faces)
+            break;
+
+        FMesh mesh;
+        make_grid(size, mesh);
+        uint64_t faces = mesh.f.size();
+
+        // obj import, the file is written first with the obj writer
+        {
+            std::string filename = file_path(directory, size, "obj");
+            std::vector<std::string> names(1, "benchmark_grid");
+            std::vector<const FMesh*> meshes(1, &mesh);
+            if(!write_obj(filename, names, meshes))
+                return status(FAILED,"could not write the benchmark obj file");
+
+            results.push_back(measure("obj import", faces, [&] (std::string& file) {
+                file = filename;
+                obj_format::mesh_data_t data;
+                status p = obj_format::read(filename, data);
+                return p.state != FAILED
+                    && data.v.size() == mesh.v.size()
+                    && data.face_count() == faces
+                    && data.fp.size() == faces*4;
+            }));
+            std::remove(filename.c_str());
+        }
+
+        // ply export
+        for(bool binary : { false, true }) {
+            // write_ply adds the name and extension to the path
+            std::stringstream path;
+            path << directory << "/benchmark_" << size << "_";
+            std::string filename = path.str() + "grid.ply";
+            write_buffer buffer;
+            results.push_back(measure(binary ? "ply export binary" : "ply export ascii", faces, [&] (std::string& file) {
+                file = filename;
+                return write_ply(path.str(), "grid", &mesh, binary, false, buffer);
+            }));
+            std::remove(filename.c_str());
+        }
+
+        // feather save and open, the mesh is moved into the scene so the
+        // largest sizes don't need two copies
+        {
+            std::string filename = file_path(directory, size, "feather");
+            double sum = checksum(mesh);
+
+            status p;
+            plugin::clear();
+            unsigned int uid = plugin::add_node(324, "benchmark_grid", p);
+            typedef field::Field<FMesh>* MeshType;
+            MeshType field = static_cast<MeshType>(plugin::get_field_base(uid, 324, 1, 0));
+            if(!field)
+                return status(FAILED,"could not make the benchmark mesh node");
+            std::swap(field->value, mesh);
+
+            results.push_back(measure("feather save", faces, [&] (std::string& file) {
+                file = filename;
+                return feather_format::save(filename);
+            }));
+
+            results.push_back(measure("feather open", faces, [&] (std::string& file) {
+                file = filename;
+                if(!feather_format::open(filename))
+                    return false;
+                unsigned int loaded = 0;
+                if(!plugin::get_node_by_name("benchmark_grid", loaded))
+                    return false;
+                MeshType f = static_cast<MeshType>(plugin::get_field_base(loaded, 324, 1, 0));
+                return f && checksum(f->value) == sum;
+            }));
+
+            plugin::clear();
+            std::remove(filename.c_str());
+        }
+    }
+
+    // camera tracks don't depend on the mesh size so they're only run once
+    {
+        std::string filename = directory + "/benchmark.fct";
+        status p;
+        plugin::clear();
+        std::vector<unsigned int> uids;
+        for(unsigned int i=0; i < cameras; i++) {
+            std::stringstream name;
+            name << "benchmark_camera" << i;
+            uids.push_back(plugin::add_node(2, name.str(), p));
+        }
+
+        results.push_back(measure("camera export", uint64_t(cameras)*frames, [&] (std::string& file) {
+            file = filename;
+            if(export_camera_tracks(filename, uids, 1, frames).state == FAILED)
+                return false;
+            track_format::reader tracks;
+            return tracks.open(filename).state != FAILED
+                && tracks.camera_count() == cameras
+                && tracks.frame_count() == unsigned(frames);
+        }));
+
+        plugin::clear();
+        std::remove(filename.c_str());
+    }
+
+    scene.restore();
+
+    for(auto& result : results)
+        if(!result.verified)
+            return status(FAILED,"a benchmark path made the wrong output");
+
+    return status();
+}
+
+void io::benchmark::print(const std::vector<result_t>& results)
+{
+    std::cout << std::left << std::setw(20) << "path"
+        << std::right << std::setw(12) << "elements"
+        << std::setw(12) << "seconds"
+        << std::setw(10) << "MB/s"
+        << std::setw(14) << "peak rss KB"
+        << std::setw(14) << "heap/element"
+        << "  check\n";
+
+    for(auto& r : results) {
+        double mbs = r.seconds > 0 ? r.bytes / r.seconds / (1024.0*1024.0) : 0;
+        std::cout << std::left << std::setw(20) << r.path
+            << std::right << std::setw(12) << r.elements
+            << std::setw(12) << std::fixed << std::setprecision(4) << r.seconds
+            << std::setw(10) << std::setprecision(1) << mbs
+            << std::setw(14) << r.peak_rss
+            << std::setw(14) << std::setprecision(2) << r.heap
+            << "  " << (r.verified ? "ok" : "FAILED") << "\n";
+    }
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+}
+
+bool io::benchmark::write_report(std::string filename, const std::vector<result_t>& results)
+{
+    std::ofstream file(filename.c_str(), std::ios::out|std::ios::trunc);
+    if(!file.is_open()) {
+        std::cout << "error opening \"" << filename << "\" benchmark report\n";
+        return false;
+    }
+
+    file << "path,elements,bytes,seconds,mb_per_second,peak_rss_kb,heap_bytes_per_element,verified\n";
+    for(auto& r : results) {
+        double mbs = r.seconds > 0 ? r.bytes / r.seconds / (1024.0*1024.0) : 0;
+        file << r.path << "," << r.elements << "," << r.bytes << "," << r.seconds << ","
+            << mbs << "," << r.peak_rss << "," << r.heap << "," << (r.verified ? 1 : 0) << "\n";
+    }
+
+    return !file.fail();
+}
@@ -0,0 +1,73 @@
+/***********************************************************************
+ *
+ * Filename: benchmark.hpp
+ *
+ * Description: Times the import and export paths on generated meshes.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <feather/types.hpp>
+#include <feather/deps.hpp>
+#include <feather/status.hpp>
+
+namespace io
+{
+
+/*
+ * BENCHMARK
+ *
+ * Each path is run on a grid of quads at 1k, 10k, 100k, 1M, 10M and 50M
+ * faces, up to the largest size asked for. The paths are obj import, ply
+ * export (ascii and binary), feather save and open, and one camera track
+ * export. Every path reads back or checks what it made so a faster path
+ * that gives the wrong answer shows up as failed instead of as a win.
+ *
+ * The feather and camera paths use the scene, it's saved to directory
+ * before the benchmark and opened again when it's done.
+ */
+    namespace benchmark
+    {
+
+        struct result_t {
+            std::string path;
+            uint64_t elements;      // faces, or camera samples for the camera path
+            uint64_t bytes;         // size of the file read or written
+            double seconds;
+            long peak_rss;          // peak resident size of the process in KB
+            double heap;            // heap growth in bytes for each element
+            bool verified;
+        };
+
+        // the files are written to directory and removed when each path is done
+        feather::status run(std::string directory, uint64_t max_faces, std::vector<result_t>& results);
+
+        void print(const std::vector<result_t>& results);
+        // csv with a line for each result for tracking the numbers over time
+        bool write_report(std::string filename, const std::vector<result_t>& results);
+
+        // square grid of quads with coords and normals, with at least faces faces
+        void make_grid(uint64_t faces, feather::FMesh& mesh);
+
+    } // namespace benchmark
+
+} // namespace io
+
+#endif
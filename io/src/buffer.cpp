@@ -0,0 +1,196 @@
+/***********************************************************************
+ *
+ * Filename: buffer.cpp
+ *
+ * Description: Reusable output buffer for the file writers.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#include "buffer.hpp"
+
+#include <cmath>
+#include <fstream>
+
+namespace
+{
+
+    // every power of ten a float can need
+    const double powers_of_10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+        1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22, 1e23,
+        1e24, 1e25, 1e26, 1e27, 1e28, 1e29, 1e30, 1e31,
+        1e32, 1e33, 1e34, 1e35, 1e36, 1e37, 1e38, 1e39,
+        1e40, 1e41, 1e42, 1e43, 1e44, 1e45, 1e46, 1e47,
+        1e48, 1e49, 1e50
+    };
+
+    const int max_power = sizeof(powers_of_10)/sizeof(double) - 1;
+
+    inline double scale(double value, int power)
+    {
+        if(power >= 0)
+            return value * powers_of_10[std::min(power, max_power)];
+        return value / powers_of_10[std::min(-power, max_power)];
+    }
+
+    // writes the digits of value backwards from p, returns the first digit
+    inline char* digits(char* p, uint64_t value)
+    {
+        do {
+            *--p = '0' + value % 10;
+            value /= 10;
+        } while(value);
+        return p;
+    }
+
+    // printf rounds exact halves to even
+    inline uint64_t round_even(double value)
+    {
+        uint64_t m = static_cast<uint64_t>(value);
+        double frac = value - m;
+        if(frac > 0.5 || (frac == 0.5 && (m & 1)))
+            ++m;
+        return m;
+    }
+
+    // significant digits written by put_float()
+    const int precision = 6;
+
+} // namespace
+
+
+void io::write_buffer::put_uint(uint64_t value)
+{
+    char tmp[20];
+    char* p = digits(tmp+20, value);
+    append(p, tmp+20-p);
+}
+
+void io::write_buffer::put_int(int64_t value)
+{
+    if(value < 0) {
+        put('-');
+        put_uint(-static_cast<uint64_t>(value));
+    } else
+        put_uint(value);
+}
+
+void io::write_buffer::put_float(float value)
+{
+    if(std::isnan(value)) {
+        append(std::signbit(value) ? "-nan" : "nan", std::signbit(value) ? 4 : 3);
+        return;
+    }
+
+    if(std::signbit(value))
+        put('-');
+
+    double v = std::fabs(static_cast<double>(value));
+
+    if(std::isinf(v)) {
+        append("inf", 3);
+        return;
+    }
+
+    if(v == 0) {
+        put('0');
+        return;
+    }
+
+    // decimal exponent of the first digit
+    int b;
+    std::frexp(v, &b);
+    int e = static_cast<int>(std::floor((b-1) * 0.30102999566398120));
+    if(v < scale(1, e))
+        --e;
+    else if(v >= scale(1, e+1))
+        ++e;
+
+    // round to the significant digits, this can carry into a new digit
+    uint64_t m = round_even(scale(v, precision-1-e));
+    if(m >= 1000000) {
+        ++e;
+        m = round_even(scale(v, precision-1-e));
+    }
+
+    char d[precision];
+    digits(d+precision, m);
+
+    // trailing zeros are never written
+    int n = precision;
+    while(n > 1 && d[n-1] == '0')
+        --n;
+
+    char tmp[32];
+    char* p = tmp;
+
+    if(e < -4 || e >= precision) {
+        *p++ = d[0];
+        if(n > 1) {
+            *p++ = '.';
+            for(int i=1; i < n; i++)
+                *p++ = d[i];
+        }
+        *p++ = 'e';
+        *p++ = (e < 0) ? '-' : '+';
+        int a = std::abs(e);
+        if(a < 10)
+            *p++ = '0';
+        char exp[4];
+        char* x = digits(exp+4, a);
+        while(x < exp+4)
+            *p++ = *x++;
+    } else if(e < 0) {
+        *p++ = '0';
+        *p++ = '.';
+        for(int i=-1; i > e; i--)
+            *p++ = '0';
+        for(int i=0; i < n; i++)
+            *p++ = d[i];
+    } else {
+        for(int i=0; i <= e; i++)
+            *p++ = d[i];
+        if(n > e+1) {
+            *p++ = '.';
+            for(int i=e+1; i < n; i++)
+                *p++ = d[i];
+        }
+    }
+
+    append(tmp, p-tmp);
+}
+
+bool io::write_buffer::write(std::string filename) const
+{
+    std::fstream file;
+    file.open(filename.c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
+    if(!file.is_open())
+        return false;
+
+    file.write(data(), _size);
+    file.close();
+    return !file.fail();
+}
+
+bool io::write_buffer::flush(std::ostream& stream)
+{
+    stream.write(data(), _size);
+    _size = 0;
+    return !stream.fail();
+}
@@ -0,0 +1,139 @@
+/***********************************************************************
+ *
+ * Filename: buffer.hpp
+ *
+ * Description: Reusable output buffer for the file writers.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#ifndef BUFFER_HPP
+#define BUFFER_HPP
+
+#include <string>
+#include <ostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <feather/types.hpp>
+
+namespace io
+{
+
+    // the mesh arrays are copied straight to and from the binary formats
+    static_assert(sizeof(feather::FVertex3D) == 3*sizeof(float), "FVertex3D must be 3 floats");
+    static_assert(sizeof(feather::FTextureCoord) == 2*sizeof(float), "FTextureCoord must be 2 floats");
+    static_assert(sizeof(feather::FFacePoint) == 3*sizeof(uint32_t), "FFacePoint must be 3 uint32s");
+
+    // size rounded up to the next multiple of align, a power of two
+    inline uint64_t padded(uint64_t size, uint64_t align=4) { return (size + align-1) & ~(align-1); }
+
+    // Reads little endian values written by write_buffer::put_binary(),
+    // the binary readers use these on their memory mapped files.
+    template <typename T>
+    inline void get_binary(const char* p, T* values, size_t count)
+    {
+        memcpy(values, p, count*sizeof(T));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        char* c = reinterpret_cast<char*>(values);
+        for(size_t i=0; i < count; i++, c+=sizeof(T))
+            std::reverse(c, c+sizeof(T));
+#endif
+    }
+
+    template <typename T>
+    inline T get_binary(const char* p)
+    {
+        T value;
+        get_binary(p, &value, 1);
+        return value;
+    }
+
+    // Collects a whole file in memory so it can be written with a single
+    // call. The memory is kept when the buffer is cleared so one buffer
+    // can be reused for every file in an export without reallocating.
+    //
+    // Text is formatted by hand, put_float() gives the same output as an
+    // ostream with the default precision (%g with 6 digits) without going
+    // through the locale and stream machinery.
+    class write_buffer
+    {
+        public:
+            void clear() { _size = 0; };
+            void reserve(size_t size) { if(size > _data.size()) _data.resize(size); };
+            size_t size() const { return _size; };
+            const char* data() const { return _data.data(); };
+
+            void append(const char* data, size_t size) {
+                memcpy(grow(size), data, size);
+            };
+
+            void append(const std::string& s) { append(s.data(), s.size()); };
+            void put(char c) { *grow(1) = c; };
+
+            void put_uint(uint64_t value);
+            void put_int(int64_t value);
+            void put_float(float value);
+
+            // values are always stored little endian
+            template <typename T>
+            void put_binary(T value) {
+                char* p = grow(sizeof(T));
+                memcpy(p, &value, sizeof(T));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                for(size_t i=0; i < sizeof(T)/2; i++)
+                    std::swap(p[i], p[sizeof(T)-1-i]);
+#endif
+            };
+
+            // arrays of 32 bit values, structs of floats can be passed as
+            // float arrays
+            template <typename T>
+            void put_binary(const T* values, size_t count) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                for(size_t i=0; i < count; i++)
+                    put_binary<T>(values[i]);
+#else
+                append(reinterpret_cast<const char*>(values), count*sizeof(T));
+#endif
+            };
+
+            // replaces the file with the buffer's contents
+            bool write(std::string filename) const;
+
+            // writes the contents to the end of the stream and clears the
+            // buffer, large files are written a chunk at a time with this
+            bool flush(std::ostream& stream);
+
+        private:
+            // returns where the next size bytes go
+            char* grow(size_t size) {
+                if(_size + size > _data.size())
+                    _data.resize(std::max(_size + size, _data.size()*2));
+                char* p = _data.data() + _size;
+                _size += size;
+                return p;
+            };
+
+            std::vector<char> _data;
+            size_t _size = 0;
+    };
+
+} // namespace io
+
+#endif
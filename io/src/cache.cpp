@@ -0,0 +1,312 @@
+/***********************************************************************
+ *
+ * Filename: cache.cpp
+ *
+ * Description: Point cache for animated meshes.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#include "cache.hpp"
+
+using namespace feather;
+using namespace io::cache_format;
+
+namespace
+{
+
+    const char magic[4] = { 'F', 'P', 'C', '\0' };
+
+    static_assert(sizeof(header_t) == 32, "header_t has to match the file");
+
+    void put_header(io::write_buffer& buffer, const header_t& header)
+    {
+        buffer.append(header.magic, 4);
+        buffer.put_binary(header.version);
+        buffer.put_binary(header.flags);
+        buffer.put_binary(header.shapes);
+        buffer.put_binary(header.frames);
+        buffer.put_binary(header.fps);
+        buffer.put_binary(header.index);
+    }
+
+    // bytes of frame data for a shape
+    inline uint64_t frame_size(const shape_t& shape, bool normals)
+    {
+        return uint64_t(shape.v + (normals ? shape.vn : 0)) * sizeof(FVertex3D);
+    }
+
+} // namespace
+
+
+io::cache_format::writer::writer()
+    : _offset(0)
+{
+}
+
+io::cache_format::writer::~writer()
+{
+    if(_file.is_open())
+        close();
+}
+
+status io::cache_format::writer::open(std::string filename, bool normals, float fps)
+{
+    _file.open(filename.c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
+    if(!_file.is_open()) {
+        std::cout << "error opening \"" << filename << "\" cache file\n";
+        return status(FAILED,"could not open cache file");
+    }
+
+    _header = header_t();
+    memcpy(_header.magic, magic, 4);
+    _header.version = version;
+    _header.flags = normals ? Normals : 0;
+    _header.fps = fps;
+    _shape.clear();
+    _frame.clear();
+
+    // the header is written again when the cache is closed
+    _buffer.clear();
+    put_header(_buffer, _header);
+    _file.write(_buffer.data(), _buffer.size());
+    _offset = _buffer.size();
+
+    return status();
+}
+
+status io::cache_format::writer::add_shape(std::string name, const FMesh& mesh)
+{
+    if(!_frame.empty())
+        return status(FAILED,"shapes have to be added before the first frame");
+
+    shape_t shape;
+    shape.namelength = name.size();
+    shape.v = mesh.v.size();
+    shape.st = mesh.st.size();
+    shape.vn = mesh.vn.size();
+    shape.f = mesh.f.size();
+    shape.fp = 0;
+    for(auto& f : mesh.f)
+        shape.fp += f.size();
+
+    _buffer.clear();
+    _buffer.put_binary(&shape.namelength, 6);
+    _buffer.append(name);
+    for(size_t i=name.size(); i < padded(name.size()); i++)
+        _buffer.put('\0');
+
+    for(auto& f : mesh.f)
+        _buffer.put_binary<uint32_t>(f.size());
+    for(auto& f : mesh.f)
+        _buffer.put_binary(reinterpret_cast<const uint32_t*>(f.data()), f.size()*3);
+    _buffer.put_binary(reinterpret_cast<const float*>(mesh.st.data()), mesh.st.size()*2);
+
+    _file.write(_buffer.data(), _buffer.size());
+    _offset += _buffer.size();
+    _shape.push_back(shape);
+    _header.shapes = _shape.size();
+
+    return status();
+}
+
+status io::cache_format::writer::write_frame(int frame, const std::vector<const FMesh*>& meshes)
+{
+    if(meshes.size() != _shape.size())
+        return status(FAILED,"wrong number of shapes for the cache");
+
+    bool normals = _header.flags & Normals;
+
+    _buffer.clear();
+    for(unsigned int i=0; i < meshes.size(); i++) {
+        const FMesh& mesh = *meshes[i];
+        if(mesh.v.size() != _shape[i].v || (normals && mesh.vn.size() != _shape[i].vn))
+            return status(FAILED,"mesh topology changed while caching");
+        _buffer.put_binary(reinterpret_cast<const float*>(mesh.v.data()), mesh.v.size()*3);
+        if(normals)
+            _buffer.put_binary(reinterpret_cast<const float*>(mesh.vn.data()), mesh.vn.size()*3);
+    }
+
+    _file.write(_buffer.data(), _buffer.size());
+    if(_file.fail())
+        return status(FAILED,"failed to write cache frame");
+
+    frame_t f;
+    f.frame = frame;
+    f.pad = 0;
+    f.offset = _offset;
+    _frame.push_back(f);
+    _offset += _buffer.size();
+
+    return status();
+}
+
+status io::cache_format::writer::close()
+{
+    if(!_file.is_open())
+        return status(FAILED,"cache isn't open");
+
+    _buffer.clear();
+    for(auto& f : _frame) {
+        _buffer.put_binary(f.frame);
+        _buffer.put_binary(f.pad);
+        _buffer.put_binary(f.offset);
+    }
+    _file.write(_buffer.data(), _buffer.size());
+
+    _header.frames = _frame.size();
+    _header.index = _offset;
+
+    _buffer.clear();
+    put_header(_buffer, _header);
+    _file.seekp(0);
+    _file.write(_buffer.data(), _buffer.size());
+
+    bool failed = _file.fail();
+    _file.close();
+
+    if(failed)
+        return status(FAILED,"failed to write cache");
+
+    return status();
+}
+
+status io::cache_format::reader::open(std::string filename)
+{
+    _shape.clear();
+    _header = header_t();
+
+    if(!_file.open(filename)) {
+        std::cout << "error loading \"" << filename << "\" cache file\n";
+        return status(FAILED,"loading error");
+    }
+
+    const char* begin = _file.begin();
+    size_t size = _file.size();
+
+    if(size < sizeof(header_t) || memcmp(begin, magic, 4))
+        return status(FAILED,"not a cache file");
+
+    _header.version = get_binary<uint32_t>(begin+4);
+    _header.flags = get_binary<uint32_t>(begin+8);
+    _header.shapes = get_binary<uint32_t>(begin+12);
+    _header.frames = get_binary<uint32_t>(begin+16);
+    _header.fps = get_binary<float>(begin+20);
+    _header.index = get_binary<uint64_t>(begin+24);
+
+    if(_header.version != version)
+        return status(FAILED,"unknown cache version");
+
+    if(_header.index > size || (size - _header.index) / sizeof(frame_t) < _header.frames)
+        return status(FAILED,"cache frame table is truncated");
+
+    // walk the shape data to find where each shape's arrays are
+    uint64_t p = sizeof(header_t);
+    uint64_t offset = 0;
+
+    for(uint32_t i=0; i < _header.shapes; i++) {
+        if(p + sizeof(shape_t) > _header.index)
+            return status(FAILED,"cache shape data is truncated");
+
+        shape_data_t shape;
+        get_binary(begin+p, &shape.size.namelength, 6);
+        p += sizeof(shape_t);
+
+        const shape_t& s = shape.size;
+        uint64_t bytes = padded(s.namelength) + uint64_t(s.f)*4 + uint64_t(s.fp)*sizeof(FFacePoint) + uint64_t(s.st)*sizeof(FTextureCoord);
+        if(bytes > _header.index - p)
+            return status(FAILED,"cache shape data is truncated");
+
+        shape.name.assign(begin+p, s.namelength);
+        p += padded(s.namelength);
+        shape.f = begin+p;
+        p += uint64_t(s.f)*4;
+
+        uint64_t fp = 0;
+        for(uint32_t j=0; j < s.f; j++)
+            fp += get_binary<uint32_t>(shape.f + j*4);
+        if(fp != s.fp)
+            return status(FAILED,"cache face data doesn't match it's face points");
+        shape.fp = begin+p;
+        p += uint64_t(s.fp)*sizeof(FFacePoint);
+        shape.st = begin+p;
+        p += uint64_t(s.st)*sizeof(FTextureCoord);
+
+        shape.offset = offset;
+        offset += frame_size(s, has_normals());
+        _shape.push_back(shape);
+    }
+
+    // every frame has to fit before the frame table
+    for(uint32_t i=0; i < _header.frames; i++) {
+        uint64_t start = get_binary<uint64_t>(begin + _header.index + i*sizeof(frame_t) + 8);
+        if(start < p || start > _header.index || _header.index - start < offset)
+            return status(FAILED,"cache frame data is truncated");
+    }
+
+    return status();
+}
+
+int io::cache_format::reader::frame(unsigned int index) const
+{
+    return get_binary<int32_t>(_file.begin() + _header.index + index*sizeof(frame_t));
+}
+
+int io::cache_format::reader::find_frame(int frame) const
+{
+    for(unsigned int i=0; i < _header.frames; i++)
+        if(this->frame(i) == frame)
+            return i;
+    return -1;
+}
+
+void io::cache_format::reader::get_topology(unsigned int shape, FMesh& mesh) const
+{
+    const shape_data_t& s = _shape.at(shape);
+
+    mesh.v.resize(s.size.v);
+    mesh.vn.resize(has_normals() ? s.size.vn : 0);
+    mesh.st.resize(s.size.st);
+    get_binary(s.st, reinterpret_cast<float*>(mesh.st.data()), s.size.st*2);
+
+    mesh.f.resize(s.size.f);
+    const char* fp = s.fp;
+    for(uint32_t i=0; i < s.size.f; i++) {
+        FFace& face = mesh.f[i];
+        face.resize(get_binary<uint32_t>(s.f + i*4));
+        get_binary(fp, reinterpret_cast<uint32_t*>(face.data()), face.size()*3);
+        fp += face.size()*sizeof(FFacePoint);
+        // the normals weren't cached, don't point into an empty vn
+        if(!has_normals())
+            for(auto& p : face)
+                p.vn = 0;
+    }
+}
+
+void io::cache_format::reader::get_frame(unsigned int index, unsigned int shape, FMesh& mesh) const
+{
+    const shape_data_t& s = _shape.at(shape);
+    const char* p = _file.begin() + get_binary<uint64_t>(_file.begin() + _header.index + index*sizeof(frame_t) + 8) + s.offset;
+
+    mesh.v.resize(s.size.v);
+    get_binary(p, reinterpret_cast<float*>(mesh.v.data()), s.size.v*3);
+
+    if(has_normals()) {
+        mesh.vn.resize(s.size.vn);
+        get_binary(p + s.size.v*sizeof(FVertex3D), reinterpret_cast<float*>(mesh.vn.data()), s.size.vn*3);
+    }
+}
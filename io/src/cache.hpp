@@ -0,0 +1,161 @@
+/***********************************************************************
+ *
+ * Filename: cache.hpp
+ *
+ * Description: Point cache for animated meshes.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <feather/types.hpp>
+#include <feather/deps.hpp>
+#include <feather/status.hpp>
+#include "mmap.hpp"
+#include "buffer.hpp"
+
+namespace io
+{
+
+/*
+ * CACHE FORMAT
+ *
+ * [header_t]
+ * SHAPE DATA
+ *      [shape_t]
+ *      [name]          // padded to 4 bytes
+ *      [f]             // vertices in each face
+ *      [fp]            // every face point
+ *      [st]            // texture coords
+ *      ...             // number of shapes based on header_t.shapes
+ * FRAME DATA
+ *      [v]             // positions of the first shape
+ *      [vn]            // normals if header_t.flags has normals
+ *      ...             // every shape in the same order, then the next frame
+ * [frame_t]            // one for each frame
+ *
+ * The topology of each shape is only written once, every frame after that
+ * is just the positions (and normals) of each shape. The frame table at the
+ * end of the file gives the offset of each frame so any frame can be read
+ * without reading the ones before it. Everything is little endian.
+ */
+    namespace cache_format
+    {
+
+        const uint32_t version = 1;
+
+        enum Flags { Normals=1 };
+
+        struct header_t {
+            char magic[4];          // "FPC\0"
+            uint32_t version;
+            uint32_t flags;
+            uint32_t shapes;
+            uint32_t frames;
+            float fps;
+            uint64_t index;         // offset of the frame table
+        };
+
+        struct shape_t {
+            uint32_t namelength;
+            uint32_t v;             // vertices
+            uint32_t st;            // texture coords
+            uint32_t vn;            // normals
+            uint32_t f;             // faces
+            uint32_t fp;            // face points
+        };
+
+        struct frame_t {
+            int32_t frame;
+            uint32_t pad;
+            uint64_t offset;
+        };
+
+        // Writes a cache a frame at a time. Every shape is added before the
+        // first frame, after that each frame has to give the shapes in the
+        // same order with the same number of vertices.
+        class writer
+        {
+            public:
+                writer();
+                ~writer();
+
+                feather::status open(std::string filename, bool normals, float fps);
+                feather::status add_shape(std::string name, const feather::FMesh& mesh);
+                feather::status write_frame(int frame, const std::vector<const feather::FMesh*>& meshes);
+                // writes the frame table, the cache isn't readable until it's closed
+                feather::status close();
+
+            private:
+                std::fstream _file;
+                header_t _header = header_t();
+                std::vector<shape_t> _shape;
+                std::vector<frame_t> _frame;
+                write_buffer _buffer;
+                uint64_t _offset;       // end of the file
+        };
+
+        // Maps the cache, the topology is read once and each frame is
+        // found through the frame table without touching the others.
+        class reader
+        {
+            public:
+                feather::status open(std::string filename);
+
+                unsigned int shape_count() const { return _shape.size(); };
+                unsigned int frame_count() const { return _header.frames; };
+                bool has_normals() const { return _header.flags & Normals; };
+                float fps() const { return _header.fps; };
+                const std::string& name(unsigned int shape) const { return _shape.at(shape).name; };
+                unsigned int vertex_count(unsigned int shape) const { return _shape.at(shape).size.v; };
+                unsigned int coord_count(unsigned int shape) const { return _shape.at(shape).size.st; };
+                unsigned int face_count(unsigned int shape) const { return _shape.at(shape).size.f; };
+                unsigned int face_point_count(unsigned int shape) const { return _shape.at(shape).size.fp; };
+
+                // frame number of the frame at index
+                int frame(unsigned int index) const;
+                // index of the frame number or -1 if it's not in the cache
+                int find_frame(int frame) const;
+
+                // fills in the faces and texture coords, v and vn are sized,
+                // face vn indices are 0 when the cache has no normals
+                void get_topology(unsigned int shape, feather::FMesh& mesh) const;
+                // fills in the positions and normals for a frame index
+                void get_frame(unsigned int index, unsigned int shape, feather::FMesh& mesh) const;
+
+            private:
+                struct shape_data_t {
+                    std::string name;
+                    shape_t size;
+                    const char* f;
+                    const char* fp;
+                    const char* st;
+                    uint64_t offset;    // from the start of each frame
+                };
+
+                mapped_file _file;
+                header_t _header = header_t();
+                std::vector<shape_data_t> _shape;
+        };
+
+    } // namespace cache_format
+
+} // namespace io
+
+#endif
@@ -4,7 +4,7 @@
  *
  * Description: Code to open and save feather files.
  *
- * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com 
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -22,585 +22,1522 @@
  ***********************************************************************/
 
 #include "feather.hpp"
+#include "buffer.hpp"
+#include "parallel.hpp"
+#include <zlib.h>
 #include <feather/plugin.hpp>
 #include <feather/field.hpp>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdio>
 
 using namespace feather;
+using namespace io::feather_format;
 
-// TODO - add support for arrays
-// Currently fields that store array values can not be save or loaded.
-// This means that KeyTracks can not save keys and needs to be fixed.
+namespace
+{
 
-bool io::feather_format::open(std::string filename) {
-    status p;
+    static_assert(sizeof(header_t) == 40, "header_t has to match the file");
+    static_assert(sizeof(toc_t) == 16, "toc_t has to match the file");
+    static_assert(sizeof(section_t) == 40, "section_t has to match the file");
 
-    std::cout << "OPEN FEATHER FILE\n";
+    // sections start on 8 byte boundaries
+    const uint64_t section_align = 8;
 
-    // clear out the scenegraph
-    plugin::clear();
+    inline uint64_t field_key(uint32_t uid, uint32_t fid) { return (uint64_t(uid) << 32) | fid; }
 
-    std::fstream file;
-    file.open(filename.c_str(),std::ios_base::in|std::ios_base::binary);
+    // Walks through the mapped file, every read checks that there's
+    // enough of the file left so a truncated file can't be read past
+    // it's end.
+    class cursor_t
+    {
+        public:
+            cursor_t(const char* begin, const char* end) : _p(begin), _end(end) { };
 
-    file.seekg(0);
-    header_t header;
-    file.read((char*)&header,sizeof(header_t));
-    std::cout << "read header\n;";
+            bool read(void* data, size_t size) {
+                if(left() < size)
+                    return false;
+                memcpy(data, _p, size);
+                _p += size;
+                return true;
+            };
 
-    std::cout << "version = " << header.major << "." << header.minor << std::endl
-        << "sframe = " << header.stime << std::endl
-        << "eframe = " << header.etime << std::endl
-        << "cframe = " << header.ctime << std::endl
-        << "fps = " << header.fps << std::endl;
+            template <typename T>
+            bool read(T& value) { return read(&value, sizeof(T)); };
 
-    std::vector<node_t> nodes;
-    std::vector<link_t> links;
-    std::vector<field_t> fields;
-
-    // READ NODES
-    uint32_t node_count; 
-    file.read((char*)&node_count,sizeof(uint32_t));
-
-    for(unsigned int i=0; i < node_count; i++){
-        node_t node;
-        std::cout << "read node\n";
-        file.read((char*)&node,sizeof(node_t));
-        char cname[node.namelength];
-        std::cout << "read node name\n";
-        file.read((char*)&cname,node.namelength);
-        std::string name;
-        name.insert(0,cname,node.namelength); 
-        std::cout << "name is " << name << ", length = " << name.size() << std::endl;
-
-        node.uid = plugin::add_node(node.nid,name,p);
-
-        std::cout << "NODE INFO FOR: " << name  << std::endl 
-            << "\tuid:" << node.uid << std::endl
-            << "\tnid:" << node.nid << std::endl
-            << "\tnamelength:" << node.namelength << std::endl;
-
-    }
-
-    // READ LINKS
-    uint32_t link_count; 
-    file.read((char*)&link_count,sizeof(uint32_t));
-
-    for(unsigned int j=0; j < link_count; j++) {
-        link_t link;
-        std::cout << "read link\n";
-        file.read((char*)&link,sizeof(link_t));
-
-        std::cout << "\tLINK INFO" << std::endl 
-            << "\tsuid:" << link.suid << std::endl
-            << "\tsfid:" << link.sfid << std::endl
-            << "\ttuid:" << link.tuid << std::endl
-            << "\ttfid:" << link.tfid << std::endl;
-        plugin::connect(link.suid,link.sfid,link.tuid,link.tfid);
-    }
-
-
-    // READ FIELDS 
-    uint32_t field_count; 
-    file.read((char*)&field_count,sizeof(uint32_t));
-
-    for(uint32_t i=0; i < field_count; i++){
-
-        std::cout << "step 1\n";
-
-        field_t field;
-        file.read((char*)&field,sizeof(field_t));
-        std::cout << "\tDATA INFO" << std::endl 
-            << "\tuid:" << field.uid << std::endl
-            << "\tnid:" << field.nid << std::endl
-            << "\tfid:" << field.fid << std::endl
-            << "\ttype:" << field.type << std::endl
-            << "\tlength:" << field.length << std::endl;
-        // set the field value
-        field::FieldBase* srcfield = plugin::get_node_field_base(field.uid,field.nid,field.fid);
-
-        bool bval;
-        int ival;
-        float fval;
-        double dval;
-        FVertex3D vertexval;
-        FVector3D vectorval;
-        FMesh meshval;
-        FColorRGB rgbval;
-        FColorRGBA rgbaval;
-        FMatrix3x3 matrix3x3val;
-        FMatrix4x4 matrix4x4val;
-        FVertexIndiceWeight vertexindiceweightval;
-        FVertexIndiceGroupWeight vertexindicegroupweightval;
-        FKey keyval;
-        FCurvePoint2D curvepoint2dval;
-        FCurvePoint3D curvepoint3dval;
+            bool skip(size_t size) {
+                if(left() < size)
+                    return false;
+                _p += size;
+                return true;
+            };
 
-        uint32_t length;
+            // reads length elements straight into the array
+            template <typename T>
+            bool read_array(std::vector<T>& array, uint32_t length) {
+                if(left() / sizeof(T) < length)
+                    return false;
+                array.resize(length);
+                return read(array.data(), length*sizeof(T));
+            };
+
+            // reads a count followed by that many elements
+            template <typename T>
+            bool read_array(std::vector<T>& array) {
+                uint32_t length;
+                return read(length) && read_array(array,length);
+            };
+
+            size_t left() const { return _end - _p; };
+            const char* pos() const { return _p; };
+
+        private:
+            const char* _p;
+            const char* _end;
+    };
+
+    // 0.1 FILES
 
+    bool read_mesh(cursor_t& c, FMesh& mesh)
+    {
+        if(!c.read_array(mesh.v) || !c.read_array(mesh.st) || !c.read_array(mesh.vn))
+            return false;
+
+        // each face has it's face point count in front of it
+        uint32_t fcount;
+        if(!c.read(fcount) || c.left() / sizeof(uint32_t) < fcount)
+            return false;
+
+        mesh.f.resize(fcount);
+        for(uint32_t i=0; i < fcount; i++)
+            if(!c.read_array(mesh.f[i]))
+                return false;
+
+        return true;
+    }
+
+    // reads a fixed size value, the length saved with the field is used
+    // so a value that doesn't match the type is skipped instead of
+    // throwing off the rest of the file
+    template <typename T>
+    bool read_value(cursor_t& c, const field_t& field, field::FieldBase* f)
+    {
+        if(field.length != sizeof(T) || !f)
+            return c.skip(field.length);
+        return c.read(static_cast<field::Field<T>*>(f)->value);
+    }
+
+    bool read_field(cursor_t& c, const field_t& field, field::FieldBase* f)
+    {
         switch(field.type){
-            case field::Bool:
-                std::cout << "read Bool value\n";
-                file.read((char*)&bval,sizeof(bool));
-                static_cast<field::Field<bool>*>(srcfield)->value = bval;
-                break;
-            case field::Int:
-                std::cout << "read Int value\n";
-                file.read((char*)&ival,sizeof(int));
-                static_cast<field::Field<int>*>(srcfield)->value = ival;
-                break;
-            case field::Float:
-                std::cout << "read Float value\n";
-                file.read((char*)&fval,sizeof(float));
-                static_cast<field::Field<float>*>(srcfield)->value = fval;
-                break;
-            case field::Double:
-                std::cout << "read Double value\n";
-                file.read((char*)&dval,sizeof(double));
-                static_cast<field::Field<double>*>(srcfield)->value = dval;
-                break;
-            case field::Real:
-                std::cout << "read Real value\n";
-                file.read((char*)&dval,sizeof(double));
-                static_cast<field::Field<double>*>(srcfield)->value = dval;
-                break;
-            case field::Vertex:
-                std::cout << "read Vertex value\n";
-                file.read((char*)&vertexval,sizeof(FVertex3D));
-                static_cast<field::Field<FVertex3D>*>(srcfield)->value = vertexval;
-                break;
-            case field::Vector:
-                std::cout << "read Vector value\n";
-                file.read((char*)&vectorval,sizeof(FVector3D));
-                static_cast<field::Field<FVector3D>*>(srcfield)->value = vectorval;
-                break;
-            case field::Mesh:
-                std::cout << "read Mesh value\n";
-                // v
-                file.read((char*)&length,sizeof(uint32_t));
-                for(uint32_t i=0; i < length; i++){
-                    FVertex3D v;
-                    file.read((char*)&v,sizeof(FVertex3D));
-                    meshval.v.push_back(v);
-                }
-                // st
-                file.read((char*)&length,sizeof(uint32_t));
-                for(uint32_t i=0; i < length; i++){
-                    FTextureCoord st;
-                    file.read((char*)&st,sizeof(FTextureCoord));
-                    meshval.st.push_back(st);
-                }
-                // vn
-                file.read((char*)&length,sizeof(uint32_t));
-                for(uint32_t i=0; i < length; i++){
-                    FVertex3D vn;
-                    file.read((char*)&vn,sizeof(FVertex3D));
-                    meshval.vn.push_back(vn);
-                }
-                // f
-                uint32_t fcount;
-                uint32_t fpcount;
-                file.read((char*)&fcount,sizeof(uint32_t));
-                for(uint32_t i=0; i < fcount; i++){
-                    file.read((char*)&fpcount,sizeof(uint32_t));
-                    FFacePoint fp;
-                    FFace face;
-                    for(uint32_t j=0; j < fpcount; j++){
-                        file.read((char*)&fp,sizeof(FFacePoint));
-                        face.push_back(fp);
-                    }
-                    meshval.f.push_back(face);
-                }
-                static_cast<field::Field<FMesh>*>(srcfield)->value = meshval;
-                break;
-            case field::RGB:
-                std::cout << "read RGB value\n";
-                file.read((char*)&rgbval,sizeof(FColorRGB));
-                static_cast<field::Field<FColorRGB>*>(srcfield)->value = rgbval;
-                break;
-            case field::RGBA:
-                std::cout << "read RGBA value\n";
-                file.read((char*)&rgbaval,sizeof(FColorRGBA));
-                static_cast<field::Field<FColorRGBA>*>(srcfield)->value = rgbaval;
-                break;
-            case field::Matrix3x3:
-                std::cout << "read Matrix3x3 value\n";
-                file.read((char*)&matrix3x3val,sizeof(FMatrix3x3));
-                static_cast<field::Field<FMatrix3x3>*>(srcfield)->value = matrix3x3val;
-                break;
-            case field::Matrix4x4:
-                std::cout << "read Matrix4x4 value\n";
-                file.read((char*)&matrix4x4val,sizeof(FMatrix4x4));
-                static_cast<field::Field<FMatrix4x4>*>(srcfield)->value = matrix4x4val;
-                break;
-            case field::VertexIndiceWeight:
-                std::cout << "read VertexIndiceWeight value\n";
-                file.read((char*)&vertexindiceweightval,sizeof(FVertexIndiceWeight));
-                static_cast<field::Field<FVertexIndiceWeight>*>(srcfield)->value = vertexindiceweightval;
-                break;
+            case field::Bool: return read_value<bool>(c,field,f);
+            case field::Int: return read_value<int>(c,field,f);
+            case field::Float: return read_value<float>(c,field,f);
+            case field::Double: return read_value<double>(c,field,f);
+            case field::Real: return read_value<double>(c,field,f);
+            case field::Vertex: return read_value<FVertex3D>(c,field,f);
+            case field::Vector: return read_value<FVector3D>(c,field,f);
+            case field::RGB: return read_value<FColorRGB>(c,field,f);
+            case field::RGBA: return read_value<FColorRGBA>(c,field,f);
+            case field::Matrix3x3: return read_value<FMatrix3x3>(c,field,f);
+            case field::Matrix4x4: return read_value<FMatrix4x4>(c,field,f);
+            case field::VertexIndiceWeight: return read_value<FVertexIndiceWeight>(c,field,f);
+            case field::Key: return read_value<FKey>(c,field,f);
+            case field::CurvePoint2D: return read_value<FCurvePoint2D>(c,field,f);
+            case field::CurvePoint3D: return read_value<FCurvePoint3D>(c,field,f);
             case field::VertexIndiceGroupWeight:
-                std::cout << "read VertexIndiceGroupWeight value\n";
-                file.read((char*)&vertexindicegroupweightval,sizeof(FVertexIndiceGroupWeight));
-                static_cast<field::Field<FVertexIndiceGroupWeight>*>(srcfield)->value = vertexindicegroupweightval;
-                break;
-            case field::Key:
-                std::cout << "read Key value\n";
-                file.read((char*)&keyval,sizeof(FKey));
-                static_cast<field::Field<FKey>*>(srcfield)->value = keyval;
-                break;
-            case field::CurvePoint2D:
-                std::cout << "read CurvePoint2D value\n";
-                file.read((char*)&curvepoint2dval,sizeof(FCurvePoint2D));
-                static_cast<field::Field<FCurvePoint2D>*>(srcfield)->value = curvepoint2dval;
-                break;
-            case field::CurvePoint3D:
-                std::cout << "read CurvePoint3D value\n";
-                file.read((char*)&curvepoint3dval,sizeof(FCurvePoint3D));
-                static_cast<field::Field<FCurvePoint3D>*>(srcfield)->value = curvepoint3dval;
-                break;
+                // this was written as raw memory and can't be read back
+                return c.skip(field.length);
+            case field::Mesh: {
+                // the length isn't saved for meshes, the mesh has it's own counts
+                FMesh mesh;
+                if(!read_mesh(c,mesh))
+                    return false;
+                if(f)
+                    std::swap(static_cast<field::Field<FMesh>*>(f)->value,mesh);
+                return true;
+            }
             default:
-                std::cout << "FAILED TO FIND VALUE TYPE!\n";
-                break;
+                std::cout << "FAILED TO FIND VALUE TYPE " << field.type << std::endl;
+                return c.skip(field.length);
         };
     }
 
-    file.close();
+    bool open_0_1(cursor_t& c)
+    {
+        status p;
 
-    return true;
-}
+        // READ NODES
+        uint32_t node_count;
+        if(!c.read(node_count)) {
+            std::cout << "feather file is truncated in the nodes\n";
+            return false;
+        }
+
+        for(unsigned int i=0; i < node_count; i++){
+            node_t node;
+            if(!c.read(node) || c.left() < node.namelength) {
+                std::cout << "feather file is truncated in the nodes\n";
+                return false;
+            }
+            std::string name(c.pos(),node.namelength);
+            c.skip(node.namelength);
+            node.uid = plugin::add_node(node.nid,name,p);
+        }
 
+        // READ LINKS
+        uint32_t link_count;
+        if(!c.read(link_count) || c.left() / sizeof(link_t) < link_count) {
+            std::cout << "feather file is truncated in the links\n";
+            return false;
+        }
 
-bool io::feather_format::save(std::string filename) {
-    std::cout << "SAVE FILE\n";
-    std::fstream file;
-    file.open(filename,std::ios_base::out|std::ios_base::binary|std::ios_base::trunc);
-
-    std::stringstream data;
-
-    unsigned int time_uid;
-    plugin::get_node_by_name("time",time_uid);
-    std::vector<unsigned int> uids; // all the scenegraph uids
-    plugin::get_nodes(uids);
-
-    header_t header;
-
-    header.major = 0;
-    header.minor = 1;
-    header.stime = static_cast<feather::field::Field<double>*>(plugin::get_field_base(time_uid,5))->value;
-    header.etime = static_cast<feather::field::Field<double>*>(plugin::get_field_base(time_uid,6))->value;
-    header.ctime = static_cast<feather::field::Field<double>*>(plugin::get_field_base(time_uid,7))->value;
-    header.fps = static_cast<feather::field::Field<double>*>(plugin::get_field_base(time_uid,8))->value;
-
-    std::cout << "write header\n"
-        << "major:" << header.major << std::endl
-        << "minor:" << header.minor << std::endl
-        << "stime:" << header.stime << std::endl
-        << "etime:" << header.etime << std::endl
-        << "fps:" << header.fps << std::endl;
-
-    file.write((char*)&header,sizeof(header));
-
-    // remove root from uid list
-    uids.erase(uids.begin());
-
-    std::vector<node_t> nodes;
-    std::vector<link_t> links;
-    std::vector<field_t> fields;
-    status p;
-
-    // FILL IN NODE, LINK and FIELD vectors 
-    for (unsigned int uid : uids){
-        node_t node;
-        node.uid = uid;
-        node.nid = plugin::get_node_id(uid,p);
-        std::string name;
-        plugin::get_node_name(uid,name,p);
-        node.namelength = strlen(name.c_str());
-        
-        nodes.push_back(node);
-        
-        //file.write((char*)&node,sizeof(node));
-        //file.write(name.c_str(),name.size());
-        // get all the node's out field connections
-        std::vector<unsigned int> fids;
-        // we are going to use the in connections to get the links since
-        // the out fields can have multiple links but the in fields can
-        // only have one
-        p = plugin::get_in_fields(uid,fids);
-
-        for (unsigned int fid : fids) {
-            field::FieldBase* srcfield = plugin::get_node_field_base(uid,node.nid,fid);
-            if(srcfield->connected()){
-                // ADD LINK
-                std::cout << "field " << fid << " connected.\n";
-                for(auto conn : srcfield->connections){
-                    link_t link;
-                    link.suid = conn.puid;
-                    link.sfid = conn.pfid;
-                    link.tuid = uid;
-                    link.tfid = fid;
-                    std::cout << "\tADD LINK" 
-                        << " suid:" << link.suid
-                        << " sfid:" << link.sfid
-                        << " tuid:" << link.tuid
-                        << " tfid:" << link.tfid
-                        << std::endl;
-                    links.push_back(link);
-                };
-            } else {
-                // ADD FIELD
-                field_t field;
-                field.uid = uid;
-                field.nid = node.nid;
-                field.fid = fid;
-                fields.push_back(field); 
+        std::vector<link_t> links(link_count);
+        c.read(links.data(),link_count*sizeof(link_t));
+
+        for(auto& link : links)
+            plugin::connect(link.suid,link.sfid,link.tuid,link.tfid);
+
+        // READ FIELDS
+        uint32_t field_count;
+        if(!c.read(field_count)) {
+            std::cout << "feather file is truncated in the fields\n";
+            return false;
+        }
+
+        for(uint32_t i=0; i < field_count; i++){
+            field_t field;
+            if(!c.read(field)) {
+                std::cout << "feather file is truncated in the fields\n";
+                return false;
             }
 
+            // set the field value
+            field::FieldBase* srcfield = plugin::get_node_field_base(field.uid,field.nid,field.fid);
+
+            if(!read_field(c,field,srcfield)) {
+                std::cout << "feather file is truncated in field " << field.fid << " of node " << field.uid << std::endl;
+                return false;
+            }
         }
 
+        // terminating string written by save
+        if(c.left() < 6 || memcmp(c.pos(),"<eof>",6))
+            std::cout << "feather file is missing it's <eof> marker\n";
+
+        std::cout << "read " << node_count << " nodes, "
+            << link_count << " links and "
+            << field_count << " fields\n";
+
+        return true;
     }
 
-    // WRITE NODES
-    uint32_t node_count = nodes.size();
-    file.write((char*)&node_count,sizeof(uint32_t));
-    for(auto node : nodes) {
-        std::string name;
-        plugin::get_node_name(node.uid,name,p);
-        file.write((char*)&node,sizeof(node_t));
-        file.write((char*)name.c_str(),node.namelength);
-        std::cout << "NODE NAME = [" << name << "], namelength=" << node.namelength << ", c_str() length=" << sizeof(name.c_str()) << std::endl;
-        std::cout << "NODE INFO FOR: " << name  << std::endl 
-            << "\tuid:" << node.uid << std::endl
-            << "\tnid:" << node.nid << std::endl
-            << "\tnamelength:" << node.namelength << std::endl;
-    }
-
-    // WRITE LINKS
-    uint32_t link_count = links.size();
-    std::cout << "link count:" << link_count << std::endl;
-    file.write((char*)&link_count,sizeof(uint32_t));
-    file.write((char*)&links[0],link_count*sizeof(link_t));
-
-    // GET FIELD TYPE AND LENGTH
-    for(uint32_t i=0; i < fields.size(); i++) {
-        field::FieldBase* srcfield = plugin::get_node_field_base(fields[i].uid,fields[i].nid,fields[i].fid);
-        fields[i].type = srcfield->type;
-        std::cout << "WRITTING FIELD " << fields[i].type << " " << srcfield->type << std::endl;
-
-        switch(srcfield->type){
-            case field::Bool:
-                fields[i].length = sizeof(bool);
-                break;
-            case field::Int:
-                fields[i].length = sizeof(int);
-                break;
-            case field::Float:
-                fields[i].length = sizeof(float);
-                break;
-            case field::Double:
-                fields[i].length = sizeof(double);
-                break;
-            case field::Real:
-                fields[i].length = sizeof(double);
+    // 2.0 FILES
+
+    template <typename T>
+    inline const T& value(const field::FieldBase* f) { return static_cast<const field::Field<T>*>(f)->value; }
+
+    template <typename T>
+    inline T& value(field::FieldBase* f) { return static_cast<field::Field<T>*>(f)->value; }
+
+    // a big value that's been taken out of it's field
+    template <typename T>
+    inline const T& big(const void* p) { return *static_cast<const T*>(p); }
+
+    // where a big field's value is
+    const void* big_value(const field::FieldBase* f)
+    {
+        switch(f->type){
+            case field::Mesh: return &value<FMesh>(f);
+            case field::MeshArray: return &value<FMeshArray>(f);
+            case field::IntArray: return &value<FIntArray>(f);
+            case field::RealArray: return &value<FRealArray>(f);
+            case field::KeyArray: return &value<FKeyArray>(f);
+            case field::VertexIndiceGroupWeight: return &value<FVertexIndiceGroupWeight>(f);
+            case field::VertexIndiceGroupWeightArray: return &value<FVertexIndiceGroupWeightArray>(f);
+            default: return nullptr;
+        };
+    }
+
+    template <typename T>
+    void put_array(io::write_buffer& buffer, const std::vector<T>& array)
+    {
+        buffer.put_binary<uint32_t>(array.size());
+        buffer.append(reinterpret_cast<const char*>(array.data()), array.size()*sizeof(T));
+    }
+
+    void put_mesh(io::write_buffer& buffer, const FMesh& mesh)
+    {
+        mesh_t size = mesh_t();
+        size.v = mesh.v.size();
+        size.st = mesh.st.size();
+        size.vn = mesh.vn.size();
+        size.f = mesh.f.size();
+        for(auto& face : mesh.f)
+            size.fp += face.size();
+
+        buffer.reserve(buffer.size() + sizeof(mesh_t)
+                + size.v*sizeof(FVertex3D)
+                + size.st*sizeof(FTextureCoord)
+                + size.vn*sizeof(FVertex3D)
+                + size.f*sizeof(uint32_t)
+                + size.fp*sizeof(FFacePoint));
+
+        buffer.append(reinterpret_cast<const char*>(&size), sizeof(mesh_t));
+        buffer.append(reinterpret_cast<const char*>(mesh.v.data()), size.v*sizeof(FVertex3D));
+        buffer.append(reinterpret_cast<const char*>(mesh.st.data()), size.st*sizeof(FTextureCoord));
+        buffer.append(reinterpret_cast<const char*>(mesh.vn.data()), size.vn*sizeof(FVertex3D));
+        for(auto& face : mesh.f)
+            buffer.put_binary<uint32_t>(face.size());
+        for(auto& face : mesh.f)
+            buffer.append(reinterpret_cast<const char*>(face.data()), face.size()*sizeof(FFacePoint));
+    }
+
+    void put_group(io::write_buffer& buffer, const FVertexIndiceGroupWeight& group)
+    {
+        buffer.put_binary<uint32_t>(group.v.size());
+        buffer.append(reinterpret_cast<const char*>(&group.weight), sizeof(FReal));
+        buffer.append(reinterpret_cast<const char*>(group.v.data()), group.v.size()*sizeof(FUInt));
+    }
+
+    template <typename T>
+    inline void put_value(io::write_buffer& buffer, const field::FieldBase* f)
+    {
+        buffer.append(reinterpret_cast<const char*>(&value<T>(f)), sizeof(T));
+    }
+
+    // encodes a big value of the field type
+    void put_big(io::write_buffer& buffer, uint32_t type, const void* p)
+    {
+        switch(type){
+            case field::Mesh: put_mesh(buffer,big<FMesh>(p)); break;
+            case field::VertexIndiceGroupWeight: put_group(buffer,big<FVertexIndiceGroupWeight>(p)); break;
+            case field::IntArray: put_array(buffer,big<FIntArray>(p)); break;
+            case field::RealArray: put_array(buffer,big<FRealArray>(p)); break;
+            case field::KeyArray: put_array(buffer,big<FKeyArray>(p)); break;
+            case field::MeshArray:
+                buffer.put_binary<uint32_t>(big<FMeshArray>(p).size());
+                for(auto& mesh : big<FMeshArray>(p))
+                    put_mesh(buffer,mesh);
                 break;
-            case field::Vertex:
-                fields[i].length = sizeof(FVertex3D);
+            case field::VertexIndiceGroupWeightArray:
+                buffer.put_binary<uint32_t>(big<FVertexIndiceGroupWeightArray>(p).size());
+                for(auto& group : big<FVertexIndiceGroupWeightArray>(p))
+                    put_group(buffer,group);
                 break;
-            case field::Vector:
-                fields[i].length = sizeof(FVector3D);
+            default:
                 break;
+        };
+    }
+
+    // returns false if the field's type can't be saved
+    bool put_field(io::write_buffer& buffer, const field::FieldBase* f)
+    {
+        switch(f->type){
+            case field::Bool: put_value<bool>(buffer,f); break;
+            case field::Int: put_value<int>(buffer,f); break;
+            case field::Float: put_value<float>(buffer,f); break;
+            case field::Double: put_value<double>(buffer,f); break;
+            case field::Real: put_value<double>(buffer,f); break;
+            case field::Vertex: put_value<FVertex3D>(buffer,f); break;
+            case field::Vector: put_value<FVector3D>(buffer,f); break;
+            case field::RGB: put_value<FColorRGB>(buffer,f); break;
+            case field::RGBA: put_value<FColorRGBA>(buffer,f); break;
+            case field::Matrix3x3: put_value<FMatrix3x3>(buffer,f); break;
+            case field::Matrix4x4: put_value<FMatrix4x4>(buffer,f); break;
+            case field::VertexIndiceWeight: put_value<FVertexIndiceWeight>(buffer,f); break;
+            case field::Key: put_value<FKey>(buffer,f); break;
+            case field::CurvePoint2D: put_value<FCurvePoint2D>(buffer,f); break;
+            case field::CurvePoint3D: put_value<FCurvePoint3D>(buffer,f); break;
             case field::Mesh:
-                break;
-            case field::RGB:
-                fields[i].length = sizeof(FColorRGB);
-                break;
-            case field::RGBA:
-                fields[i].length = sizeof(FColorRGBA);
-                break;
-            case field::Matrix3x3:
-                fields[i].length = sizeof(FMatrix3x3);
-                break;
-            case field::Matrix4x4:
-                fields[i].length = sizeof(FMatrix4x4);
-                break;
-            case field::VertexIndiceWeight:
-                fields[i].length = sizeof(FVertexIndiceWeight);
-                break;
             case field::VertexIndiceGroupWeight:
-                fields[i].length = sizeof(FVertexIndiceGroupWeight);
-                break;
-            case field::Key:
-                fields[i].length = sizeof(FKey);
-                break;
-            case field::CurvePoint2D:
-                fields[i].length = sizeof(FCurvePoint2D);
-                break;
-            case field::CurvePoint3D:
-                fields[i].length = sizeof(FCurvePoint3D);
+            case field::IntArray:
+            case field::RealArray:
+            case field::KeyArray:
+            case field::MeshArray:
+            case field::VertexIndiceGroupWeightArray:
+                put_big(buffer,f->type,big_value(f));
                 break;
             default:
-                std::cout << "FAILED TO FIND VALUE TYPE!\n";
-                fields[i].length = 0;
-                break;            
+                return false;
         };
+        return true;
+    }
+
+    bool get_mesh(cursor_t& c, FMesh& mesh)
+    {
+        mesh_t size;
+        std::vector<uint32_t> fsize;
+        if(!c.read(size)
+                || !c.read_array(mesh.v,size.v)
+                || !c.read_array(mesh.st,size.st)
+                || !c.read_array(mesh.vn,size.vn)
+                || !c.read_array(fsize,size.f)
+                || c.left() / sizeof(FFacePoint) < size.fp)
+            return false;
+
+        // the face points of every face are together after the face sizes
+        uint64_t count = 0;
+        for(uint32_t n : fsize)
+            count += n;
+        if(count != size.fp)
+            return false;
+
+        const char* fp = c.pos();
+        mesh.f.resize(size.f);
+        for(uint32_t i=0; i < size.f; i++) {
+            mesh.f[i].resize(fsize[i]);
+            memcpy(mesh.f[i].data(), fp, fsize[i]*sizeof(FFacePoint));
+            fp += fsize[i]*sizeof(FFacePoint);
+        }
+
+        return c.skip(size.fp*sizeof(FFacePoint));
+    }
 
-    } 
-
-
-    // WRITE FIELD DATA
-
-    uint32_t field_count = fields.size();
-    file.write((char*)&field_count,sizeof(uint32_t));
-
-    for(auto field : fields) {
-        field::FieldBase* srcfield = plugin::get_node_field_base(field.uid,field.nid,field.fid);
-        file.write((char*)&field,sizeof(field_t));
-        std::cout << "WRITTING TYPE " << field.type << " " << srcfield->type << std::endl;
-        std::cout << "WRITTING LENGTH " << field.length << std::endl;
-
-        bool bval;
-        int ival;
-        float fval;
-        double dval;
-        FVertex3D vertexval;
-        FVector3D vectorval;
-        FMesh meshval;
-        FColorRGB rgbval;
-        FColorRGBA rgbaval;
-        FMatrix3x3 matrix3x3val;
-        FMatrix4x4 matrix4x4val;
-        FVertexIndiceWeight vertexindiceweightval;
-        FVertexIndiceGroupWeight vertexindicegroupweightval;
-        FKey keyval;
-        FCurvePoint2D curvepoint2dval;
-        FCurvePoint3D curvepoint3dval;
+    bool get_group(cursor_t& c, FVertexIndiceGroupWeight& group)
+    {
         uint32_t length;
+        return c.read(length) && c.read(group.weight) && c.read_array(group.v,length);
+    }
 
-        switch(srcfield->type){
-            case field::Bool:
-                std::cout << "write Bool field\n";
-                bval = static_cast<field::Field<bool>*>(srcfield)->value;
-                file.write((char*)&bval,field.length);
-                break;
-            case field::Int:
-                std::cout << "write Int field\n";
-                ival = static_cast<field::Field<int>*>(srcfield)->value;
-                file.write((char*)&ival,field.length);
-                break;
-            case field::Float:
-                std::cout << "write Float field\n";
-                fval = static_cast<field::Field<float>*>(srcfield)->value;
-                file.write((char*)&fval,field.length);
-                break;
-            case field::Double:
-                std::cout << "write Double field\n";
-                dval = static_cast<field::Field<double>*>(srcfield)->value;
-                file.write((char*)&dval,field.length);
-                break;
-            case field::Real:
-                std::cout << "write Real field\n";
-                dval = static_cast<field::Field<double>*>(srcfield)->value;
-                file.write((char*)&dval,field.length);
-                break;
-            case field::Vertex:
-                std::cout << "write Vertex field\n";
-                vertexval = static_cast<field::Field<FVertex3D>*>(srcfield)->value;
-                file.write((char*)&vertexval,field.length);
-                break;
-            case field::Vector:
-                std::cout << "write Vector field\n";
-                vectorval = static_cast<field::Field<FVector3D>*>(srcfield)->value;
-                file.write((char*)&vectorval,field.length);
-                break;
-            case field::Mesh:
-                std::cout << "write Mesh field\n";
-                meshval = static_cast<field::Field<FMesh>*>(srcfield)->value;
-                // v
-                length = meshval.v.size();
-                file.write((char*)&length,sizeof(uint32_t));
-                file.write((char*)&meshval.v[0],length*sizeof(FVertex3D));
-                // st
-                length = meshval.st.size();
-                file.write((char*)&length,sizeof(uint32_t));
-                file.write((char*)&static_cast<field::Field<FMesh>*>(srcfield)->value.st[0],length*sizeof(FTextureCoord));
-                // vn
-                length = meshval.vn.size();
-                file.write((char*)&length,sizeof(uint32_t));
-                file.write((char*)&static_cast<field::Field<FMesh>*>(srcfield)->value.vn[0],length*sizeof(FVertex3D));
-                // f
-                length = meshval.f.size();
-                file.write((char*)&length,sizeof(uint32_t));
-                for(uint32_t i=0; i < meshval.f.size(); i++){
-                    length = meshval.f[i].size();
-                    file.write((char*)&length,sizeof(uint32_t));
-                    // write each face point
-                    for(uint32_t j=0; j < length; j++){
-                        file.write((char*)&static_cast<field::Field<FMesh>*>(srcfield)->value.f[i][j],sizeof(FFacePoint));
+    bool get_field(cursor_t& c, uint32_t type, field::FieldBase* f)
+    {
+        uint32_t length;
+
+        switch(type){
+            case field::Bool: return c.read(value<bool>(f));
+            case field::Int: return c.read(value<int>(f));
+            case field::Float: return c.read(value<float>(f));
+            case field::Double: return c.read(value<double>(f));
+            case field::Real: return c.read(value<double>(f));
+            case field::Vertex: return c.read(value<FVertex3D>(f));
+            case field::Vector: return c.read(value<FVector3D>(f));
+            case field::RGB: return c.read(value<FColorRGB>(f));
+            case field::RGBA: return c.read(value<FColorRGBA>(f));
+            case field::Matrix3x3: return c.read(value<FMatrix3x3>(f));
+            case field::Matrix4x4: return c.read(value<FMatrix4x4>(f));
+            case field::VertexIndiceWeight: return c.read(value<FVertexIndiceWeight>(f));
+            case field::Key: return c.read(value<FKey>(f));
+            case field::CurvePoint2D: return c.read(value<FCurvePoint2D>(f));
+            case field::CurvePoint3D: return c.read(value<FCurvePoint3D>(f));
+            case field::Mesh: return get_mesh(c,value<FMesh>(f));
+            case field::VertexIndiceGroupWeight: return get_group(c,value<FVertexIndiceGroupWeight>(f));
+            case field::IntArray: return c.read_array(value<FIntArray>(f));
+            case field::RealArray: return c.read_array(value<FRealArray>(f));
+            case field::KeyArray: return c.read_array(value<FKeyArray>(f));
+            case field::MeshArray: {
+                FMeshArray& meshes = value<FMeshArray>(f);
+                // every mesh is at least it's mesh_t
+                if(!c.read(length) || c.left() / sizeof(mesh_t) < length)
+                    return false;
+                meshes.resize(length);
+                for(auto& mesh : meshes)
+                    if(!get_mesh(c,mesh))
+                        return false;
+                return true;
+            }
+            case field::VertexIndiceGroupWeightArray: {
+                FVertexIndiceGroupWeightArray& groups = value<FVertexIndiceGroupWeightArray>(f);
+                if(!c.read(length) || c.left() / (sizeof(uint32_t)+sizeof(FReal)) < length)
+                    return false;
+                groups.resize(length);
+                for(auto& group : groups)
+                    if(!get_group(c,group))
+                        return false;
+                return true;
+            }
+            default:
+                return false;
+        };
+    }
+
+    // COMPRESSION
+
+    // each 32 bit word has the one 12 bytes before it taken away
+    void delta(char* data, size_t size)
+    {
+        size_t count = size / sizeof(uint32_t);
+        for(size_t i=count; i-- > 3;) {
+            uint32_t a, b;
+            memcpy(&a, data + i*4, 4);
+            memcpy(&b, data + (i-3)*4, 4);
+            a -= b;
+            memcpy(data + i*4, &a, 4);
+        }
+    }
+
+    void undelta(char* data, size_t size)
+    {
+        size_t count = size / sizeof(uint32_t);
+        for(size_t i=3; i < count; i++) {
+            uint32_t a, b;
+            memcpy(&a, data + i*4, 4);
+            memcpy(&b, data + (i-3)*4, 4);
+            a += b;
+            memcpy(data + i*4, &a, 4);
+        }
+    }
+
+    // puts byte j of every word together, bytes after the last whole
+    // word are left where they are
+    void shuffle(const char* in, char* out, size_t size)
+    {
+        size_t count = size / 4;
+        for(size_t i=0; i < count; i++)
+            for(size_t j=0; j < 4; j++)
+                out[j*count + i] = in[i*4 + j];
+        memcpy(out + count*4, in + count*4, size - count*4);
+    }
+
+    void unshuffle(const char* in, char* out, size_t size)
+    {
+        size_t count = size / 4;
+        for(size_t i=0; i < count; i++)
+            for(size_t j=0; j < 4; j++)
+                out[i*4 + j] = in[j*count + i];
+        memcpy(out + count*4, in + count*4, size - count*4);
+    }
+
+    // Splits the data into blocks that are filtered and compressed on the
+    // thread pool. A block that doesn't get smaller is stored as is.
+    void compress(const io::write_buffer& data, uint32_t filter, unsigned int threads, io::write_buffer& out)
+    {
+        uint32_t count = (data.size() + block_size - 1) / block_size;
+        std::vector<std::vector<char>> blocks(count);
+        std::vector<block_size_t> sizes(count);
+
+        io::parallel_for(count, threads, [&] (unsigned int i) {
+                const char* start = data.data() + size_t(i)*block_size;
+                uint32_t length = std::min<size_t>(block_size, data.size() - size_t(i)*block_size);
+
+                std::vector<char> block(start, start + length);
+                if(filter & Delta)
+                    delta(block.data(), length);
+                if(filter & Shuffle) {
+                    std::vector<char> shuffled(length);
+                    shuffle(block.data(), shuffled.data(), length);
+                    std::swap(block, shuffled);
+                }
+
+                uLongf size = compressBound(length);
+                blocks[i].resize(size);
+                if(compress2(reinterpret_cast<Bytef*>(blocks[i].data()), &size,
+                            reinterpret_cast<const Bytef*>(block.data()), length, Z_BEST_SPEED) != Z_OK
+                        || size >= length) {
+                    std::swap(blocks[i], block);
+                    size = length;
+                }
+                blocks[i].resize(size);
+
+                sizes[i].size = size;
+                sizes[i].length = length;
+                });
+
+        block_t header;
+        header.count = count;
+        header.filter = filter;
+        header.length = data.size();
+        out.append(reinterpret_cast<const char*>(&header), sizeof(block_t));
+        out.append(reinterpret_cast<const char*>(sizes.data()), count*sizeof(block_size_t));
+        for(auto& block : blocks)
+            out.append(block.data(), block.size());
+    }
+
+    // unpacks the blocks of a compressed section on every core
+    bool uncompress(const char* data, uint64_t size, std::vector<char>& out)
+    {
+        cursor_t c(data, data + size);
+        block_t header;
+        std::vector<block_size_t> sizes;
+        if(!c.read(header) || !c.read_array(sizes,header.count))
+            return false;
+
+        // where each block is in the file and in the output
+        std::vector<uint64_t> in(header.count+1, c.pos() - data), at(header.count+1, 0);
+        for(uint32_t i=0; i < header.count; i++) {
+            if(sizes[i].length > block_size || sizes[i].size > sizes[i].length)
+                return false;
+            in[i+1] = in[i] + sizes[i].size;
+            at[i+1] = at[i] + sizes[i].length;
+        }
+        if(in[header.count] > size || at[header.count] != header.length)
+            return false;
+
+        out.resize(header.length);
+        std::atomic<bool> failed(false);
+
+        io::parallel_for(header.count, 0, [&] (unsigned int i) {
+                char* block = out.data() + at[i];
+                uint32_t length = sizes[i].length;
+
+                std::vector<char> filtered(length);
+                if(sizes[i].size == length)
+                    memcpy(filtered.data(), data + in[i], length);
+                else {
+                    uLongf unpacked = length;
+                    if(::uncompress(reinterpret_cast<Bytef*>(filtered.data()), &unpacked,
+                                reinterpret_cast<const Bytef*>(data + in[i]), sizes[i].size) != Z_OK
+                            || unpacked != length) {
+                        failed = true;
+                        return;
                     }
                 }
-                break;
-            case field::RGB:
-                std::cout << "write RGB field\n";
-                rgbval = static_cast<field::Field<FColorRGB>*>(srcfield)->value;
-                file.write((char*)&rgbval,field.length);
-                break;
-            case field::RGBA:
-                std::cout << "write RGBA field\n";
-                rgbaval = static_cast<field::Field<FColorRGBA>*>(srcfield)->value;
-                file.write((char*)&rgbaval,field.length);
-                break;
-            case field::Matrix3x3:
-                std::cout << "write Matrix3x3 field\n";
-                matrix3x3val = static_cast<field::Field<FMatrix3x3>*>(srcfield)->value;
-                file.write((char*)&matrix3x3val,field.length);
-                break;
-            case field::Matrix4x4:
-                std::cout << "write Matrix4x4 field\n";
-                matrix4x4val = static_cast<field::Field<FMatrix4x4>*>(srcfield)->value;
-                file.write((char*)&matrix4x4val,field.length);
-                break;
-            case field::VertexIndiceWeight:
-                std::cout << "write VertexIndiceWeight field\n";
-                vertexindiceweightval = static_cast<field::Field<FVertexIndiceWeight>*>(srcfield)->value;
-                file.write((char*)&vertexindiceweightval,field.length);
-                break;
+
+                if(header.filter & Shuffle)
+                    unshuffle(filtered.data(), block, length);
+                else
+                    memcpy(block, filtered.data(), length);
+                if(header.filter & Delta)
+                    undelta(block, length);
+                });
+
+        return !failed;
+    }
+
+    // field data as it was before it was saved, compressed sections are
+    // unpacked into the buffer
+    bool field_data(const reader& file, const section_t& section, std::vector<char>& buffer, cursor_t& c)
+    {
+        if(!(section.flags & Compressed)) {
+            c = cursor_t(file.data(section), file.data(section) + section.size);
+            return true;
+        }
+
+        if(!uncompress(file.data(section), section.size, buffer))
+            return false;
+        c = cursor_t(buffer.data(), buffer.data() + buffer.size());
+        return true;
+    }
+
+    // Values left in the file by a lazy open. The file stays mapped
+    // until every value has been read or another file is opened.
+    struct lazy_t {
+        std::shared_ptr<reader> file;
+        std::unordered_map<uint32_t,std::vector<const section_t*>> fields;  // node uid to it's sections
+        std::unordered_multimap<uint32_t,uint32_t> inputs;                  // node uid to the nodes linked into it
+        unsigned int count = 0;
+
+        void clear() {
+            file.reset();
+            fields.clear();
+            inputs.clear();
+            count = 0;
+        };
+    };
+
+    lazy_t lazy;
+
+    // guards lazy and saved, a save can run on another thread
+    std::mutex mutex;
+
+    // only the big values are left in the file
+    inline bool is_lazy(uint32_t type) { return type == field::Mesh || type == field::MeshArray; }
+
+    // a value that was set after the open is newer than the file
+    bool is_empty(const field::FieldBase* f)
+    {
+        if(f->type == field::Mesh)
+            return value<FMesh>(f).v.empty() && value<FMesh>(f).f.empty();
+        return value<FMeshArray>(f).empty();
+    }
+
+    // the field of a node in the scene that a section holds the value for
+    field::FieldBase* lazy_field(uint32_t uid, const section_t& section)
+    {
+        field::FieldBase* f = plugin::get_node_field_base(uid,section.nid,section.fid);
+        if(!f || f->type != int(section.ftype) || !is_empty(f))
+            return nullptr;
+        return f;
+    }
+
+    // section holding a value that's still in the file, the mutex has
+    // to be held
+    const section_t* lazy_section(uint32_t uid, uint32_t fid)
+    {
+        auto it = lazy.fields.find(uid);
+        if(it == lazy.fields.end())
+            return nullptr;
+        for(const section_t* section : it->second)
+            if(section->fid == fid && lazy_field(uid,*section))
+                return section;
+        return nullptr;
+    }
+
+    // reads the node's values, the mutex has to be held
+    unsigned int load_node(uint32_t uid)
+    {
+        auto it = lazy.fields.find(uid);
+        if(it == lazy.fields.end())
+            return 0;
+
+        unsigned int loaded = 0;
+        for(const section_t* section : it->second) {
+            field::FieldBase* f = lazy_field(uid,*section);
+            if(!f)
+                continue;
+            std::vector<char> buffer;
+            cursor_t c(nullptr,nullptr);
+            if(!field_data(*lazy.file,*section,buffer,c) || !get_field(c,section->ftype,f)) {
+                std::cout << "feather file is truncated in field " << section->fid << " of node " << uid << std::endl;
+                continue;
+            }
+            f->update = true;
+            loaded++;
+        }
+
+        lazy.count -= it->second.size();
+        lazy.fields.erase(it);
+
+        // nothing else needs the file
+        if(!lazy.count)
+            lazy.clear();
+
+        return loaded;
+    }
+
+    // HASHING
+
+    inline uint64_t hash(uint64_t h, const void* data, size_t size)
+    {
+        const char* p = static_cast<const char*>(data);
+        for(; size >= 8; size -= 8, p += 8) {
+            uint64_t w;
+            memcpy(&w, p, 8);
+            h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+            h ^= h >> 32;
+        }
+        for(; size; size--, p++)
+            h = (h ^ uint8_t(*p)) * 0x100000001b3ULL;
+        return h;
+    }
+
+    template <typename T>
+    inline uint64_t hash(uint64_t h, T value) { return hash(h, &value, sizeof(T)); }
+
+    template <typename T>
+    inline uint64_t hash(uint64_t h, const std::vector<T>& array)
+    {
+        h = hash(h, array.size());
+        return hash(h, array.data(), array.size()*sizeof(T));
+    }
+
+    uint64_t hash(uint64_t h, const FMesh& mesh)
+    {
+        h = hash(h, mesh.v);
+        h = hash(h, mesh.st);
+        h = hash(h, mesh.vn);
+        h = hash(h, mesh.f.size());
+        for(auto& face : mesh.f)
+            h = hash(h, face);
+        return h;
+    }
+
+    uint64_t hash(uint64_t h, const FVertexIndiceGroupWeight& group)
+    {
+        h = hash(h, group.weight);
+        return hash(h, group.v);
+    }
+
+    // values that are worth not writing again if they haven't changed,
+    // everything else is small enough to always write
+    inline bool is_big(uint32_t type)
+    {
+        switch(type){
+            case field::Mesh:
+            case field::MeshArray:
+            case field::IntArray:
+            case field::RealArray:
+            case field::KeyArray:
             case field::VertexIndiceGroupWeight:
-                std::cout << "write VertexIndiceGroupWeight field\n";
-                vertexindicegroupweightval = static_cast<field::Field<FVertexIndiceGroupWeight>*>(srcfield)->value;
-                file.write((char*)&vertexindicegroupweightval,field.length);
-                break;
-            case field::Key:
-                std::cout << "write Key field\n";
-                keyval = static_cast<field::Field<FKey>*>(srcfield)->value;
-                file.write((char*)&keyval,field.length);
-                break;
-            case field::CurvePoint2D:
-                std::cout << "write CurvePoint2D field\n";
-                curvepoint2dval = static_cast<field::Field<FCurvePoint2D>*>(srcfield)->value;
-                file.write((char*)&curvepoint2dval,field.length);
-                break;
-            case field::CurvePoint3D:
-                std::cout << "write CurvePoint3D field\n";
-                curvepoint3dval = static_cast<field::Field<FCurvePoint3D>*>(srcfield)->value;
-                file.write((char*)&curvepoint3dval,field.length);
-                break;
+            case field::VertexIndiceGroupWeightArray:
+                return true;
             default:
-                std::cout << "FAILED TO FIND VALUE TYPE!\n";
-                break;
+                return false;
         };
+    }
 
-        std::cout << "\tDATA INFO" << std::endl 
-            << "\tfid:" << field.fid << std::endl
-            << "\ttype:" << field.type << std::endl
-            << "\tlength:" << field.length << std::endl;
+    // fingerprint of a big value to tell if it's changed since it was saved
+    uint64_t hash_big(uint32_t type, const void* p)
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        switch(type){
+            case field::Mesh: return hash(h, big<FMesh>(p));
+            case field::IntArray: return hash(h, big<FIntArray>(p));
+            case field::RealArray: return hash(h, big<FRealArray>(p));
+            case field::KeyArray: return hash(h, big<FKeyArray>(p));
+            case field::VertexIndiceGroupWeight: return hash(h, big<FVertexIndiceGroupWeight>(p));
+            case field::MeshArray:
+                h = hash(h, big<FMeshArray>(p).size());
+                for(auto& mesh : big<FMeshArray>(p))
+                    h = hash(h, mesh);
+                return h;
+            case field::VertexIndiceGroupWeightArray:
+                h = hash(h, big<FVertexIndiceGroupWeightArray>(p).size());
+                for(auto& group : big<FVertexIndiceGroupWeightArray>(p))
+                    h = hash(h, group);
+                return h;
+            default:
+                return h;
+        };
+    }
 
+    inline uint64_t hash_field(const field::FieldBase* f) { return hash_big(f->type, big_value(f)); }
+
+    // a copy of a big value that the scene can't change
+    std::shared_ptr<const void> copy_big(const field::FieldBase* f)
+    {
+        switch(f->type){
+            case field::Mesh: return std::make_shared<FMesh>(value<FMesh>(f));
+            case field::MeshArray: return std::make_shared<FMeshArray>(value<FMeshArray>(f));
+            case field::IntArray: return std::make_shared<FIntArray>(value<FIntArray>(f));
+            case field::RealArray: return std::make_shared<FRealArray>(value<FRealArray>(f));
+            case field::KeyArray: return std::make_shared<FKeyArray>(value<FKeyArray>(f));
+            case field::VertexIndiceGroupWeight: return std::make_shared<FVertexIndiceGroupWeight>(value<FVertexIndiceGroupWeight>(f));
+            case field::VertexIndiceGroupWeightArray: return std::make_shared<FVertexIndiceGroupWeightArray>(value<FVertexIndiceGroupWeightArray>(f));
+            default: return nullptr;
+        };
+    }
+
+    // A big value in the file that was last saved or opened. An
+    // incremental save reuses the section if the value's hash hasn't
+    // changed, or if it's still waiting in the lazy file it came from.
+    struct saved_field_t {
+        section_t section = section_t();
+        uint64_t hash = 0;
+        const section_t* lazy = nullptr;    // the lazy section it was copied from
+    };
+
+    // The file that was last saved or opened, an incremental save can
+    // only add to it if nothing else has written to it since.
+    struct saved_t {
+        std::string filename;
+        uint64_t end = 0;   // size of the file
+        std::unordered_map<uint64_t,saved_field_t> fields;     // by the scene's uid and fid
+
+        void clear() {
+            filename.clear();
+            end = 0;
+            fields.clear();
+        };
+    };
+
+    saved_t saved;
+
+    uint64_t file_size(std::string filename)
+    {
+        std::ifstream file(filename,std::ios_base::in|std::ios_base::binary|std::ios_base::ate);
+        return file.is_open() ? uint64_t(file.tellg()) : 0;
+    }
+
+    bool open_2_0(std::shared_ptr<reader> lazyfile, std::string filename)
+    {
+        const reader& file = *lazyfile;
+        status p;
+        uint32_t node_count=0, link_count=0, field_count=0;
+
+        // the uids in the file are from when it was saved, the new nodes
+        // can get different ones
+        std::unordered_map<uint32_t,uint32_t> uids;
+        uids[0] = 0;
+
+        // READ NODES
+        for(auto& section : file.sections()) {
+            if(section.type != NodeSection)
+                continue;
+
+            cursor_t c(file.data(section), file.data(section) + section.size);
+            node_t node;
+            while(c.read(node)) {
+                if(c.left() < node.namelength) {
+                    std::cout << "feather node section is truncated\n";
+                    return false;
+                }
+                std::string name(c.pos(),node.namelength);
+                c.skip(node.namelength);
+                uids[node.uid] = plugin::add_node(node.nid,name,p);
+                node_count++;
+            }
+        }
+
+        // READ LINKS
+        for(auto& section : file.sections()) {
+            if(section.type != LinkSection)
+                continue;
+
+            cursor_t c(file.data(section), file.data(section) + section.size);
+            link_t link;
+            while(c.read(link)) {
+                if(!uids.count(link.suid) || !uids.count(link.tuid)) {
+                    std::cout << "feather link " << link.suid << " to " << link.tuid << " has a missing node\n";
+                    continue;
+                }
+                plugin::connect(uids[link.suid],link.sfid,uids[link.tuid],link.tfid);
+                link_count++;
+                if(lazy.file)
+                    lazy.inputs.insert(std::make_pair(uids[link.tuid],uids[link.suid]));
+            }
+        }
+
+        // READ FIELDS
+        std::vector<char> buffer;
+        for(auto& section : file.sections()) {
+            if(section.type != FieldSection)
+                continue;
+
+            field::FieldBase* srcfield = nullptr;
+            if(uids.count(section.uid))
+                srcfield = plugin::get_node_field_base(uids[section.uid],section.nid,section.fid);
+
+            if(!srcfield || srcfield->type != int(section.ftype)) {
+                std::cout << "feather field " << section.fid << " of node " << section.uid << " doesn't match the scene, skipping\n";
+                continue;
+            }
+
+            saved_field_t& stored = saved.fields[field_key(uids[section.uid],section.fid)];
+            stored.section = section;
+            stored.hash = 0;
+            stored.lazy = nullptr;
+
+            if(lazy.file && is_lazy(section.ftype)) {
+                lazy.fields[uids[section.uid]].push_back(&section);
+                lazy.count++;
+                stored.lazy = &section;
+                continue;
+            }
+
+            cursor_t c(nullptr,nullptr);
+            if(!field_data(file,section,buffer,c) || !get_field(c,section.ftype,srcfield)) {
+                std::cout << "feather file is truncated in field " << section.fid << " of node " << section.uid << std::endl;
+                return false;
+            }
+            if(is_big(section.ftype))
+                stored.hash = hash_field(srcfield);
+            field_count++;
+        }
+
+        // later incremental saves can add to this file
+        saved.filename = filename;
+        saved.end = file_size(filename);
+
+        std::cout << "read " << node_count << " nodes, "
+            << link_count << " links and "
+            << field_count << " fields\n";
+
+        if(lazy.file)
+            std::cout << lazy.count << " fields left in the file\n";
+
+        if(!lazy.count)
+            lazy.clear();
+
+        return true;
+    }
+
+    // writes the data as the next section and adds it to the table
+    void write_section(std::ostream& file, const char* data, uint64_t size, section_t section, uint64_t& offset, std::vector<section_t>& sections)
+    {
+        section.offset = offset;
+        section.size = size;
+        sections.push_back(section);
+
+        // pad out to the start of the next section
+        const char pad[8] = {};
+        file.write(data,size);
+        file.write(pad,io::padded(size,section_align) - size);
+        offset += io::padded(size,section_align);
+    }
+
+    // SNAPSHOTS
+
+    // A field value held by a snapshot. The value is either encoded in
+    // data, still in the lazily opened file or unchanged in the file an
+    // incremental save is adding to. Big values are held as they are in
+    // value until the save hashes and encodes them.
+    struct snapshot_field_t {
+        section_t section = section_t();
+        std::shared_ptr<io::write_buffer> data;
+        std::shared_ptr<const void> value;      // big value still to be encoded
+        const section_t* stored = nullptr;     // section in snapshot_t::lazyfile
+        bool unchanged = false;
+        saved_field_t saved;                    // remembered for the next save
+        saved_field_t last;                     // what the last save wrote, if has_last
+        bool has_last = false;
+    };
+
+    // Everything a save writes, taken from the scene so the file can be
+    // written while the scene keeps changing.
+    struct snapshot_t {
+        std::string filename;
+        bool compress = false;
+        uint32_t filter = 0;
+        unsigned int threads = 0;
+        bool incremental = false;
+        bool background = false;                // big values are copied out of the scene
+        uint64_t end = 0;                       // where an incremental save starts
+        header_t header;
+        io::write_buffer nodes;
+        std::vector<link_t> links;
+        std::vector<snapshot_field_t> fields;
+        std::shared_ptr<reader> lazyfile;       // keeps the stored sections mapped
+        unsigned int node_count = 0;
+        unsigned int skipped = 0;
+        uint64_t bytes = 0;                     // field data to write
+    };
+
+    // Walks the scene and copies out everything the save needs, the mutex
+    // has to be held. Big values that are still in the lazy file aren't
+    // copied, the rest are only copied for a background save and are
+    // hashed and encoded later by prepare_snapshot().
+    void take_snapshot(snapshot_t& snapshot)
+    {
+        // an incremental save can only add to the file the last save wrote
+        if(snapshot.incremental && (saved.filename != snapshot.filename || saved.end == 0 || file_size(snapshot.filename) != saved.end)) {
+            std::cout << "\"" << snapshot.filename << "\" has changed since it was last saved, writing the whole file\n";
+            snapshot.incremental = false;
+        }
+        snapshot.end = saved.end;
+
+        unsigned int time_uid;
+        plugin::get_node_by_name("time",time_uid);
+        std::vector<unsigned int> uids; // all the scenegraph uids
+        plugin::get_nodes(uids);
+
+        header_t& header = snapshot.header;
+        header.major = version_major;
+        header.minor = version_minor;
+        header.stime = static_cast<feather::field::Field<double>*>(plugin::get_field_base(time_uid,5))->value;
+        header.etime = static_cast<feather::field::Field<double>*>(plugin::get_field_base(time_uid,6))->value;
+        header.ctime = static_cast<feather::field::Field<double>*>(plugin::get_field_base(time_uid,7))->value;
+        header.fps = static_cast<feather::field::Field<double>*>(plugin::get_field_base(time_uid,8))->value;
+
+        snapshot.lazyfile = lazy.file;
+
+        // remove root from uid list
+        uids.erase(uids.begin());
+
+        status p;
+        for (unsigned int uid : uids){
+            node_t node;
+            node.uid = uid;
+            node.nid = plugin::get_node_id(uid,p);
+            std::string name;
+            plugin::get_node_name(uid,name,p);
+            node.namelength = name.size();
+            snapshot.nodes.append((char*)&node,sizeof(node_t));
+            snapshot.nodes.append(name);
+            snapshot.node_count++;
+
+            // we are going to use the in connections to get the links since
+            // the out fields can have multiple links but the in fields can
+            // only have one
+            std::vector<unsigned int> fids;
+            p = plugin::get_in_fields(uid,fids);
+
+            for (unsigned int fid : fids) {
+                field::FieldBase* srcfield = plugin::get_node_field_base(uid,node.nid,fid);
+                if(!srcfield)
+                    continue;
+                if(srcfield->connected()){
+                    for(auto conn : srcfield->connections){
+                        link_t link;
+                        link.suid = conn.puid;
+                        link.sfid = conn.pfid;
+                        link.tuid = uid;
+                        link.tfid = fid;
+                        snapshot.links.push_back(link);
+                    };
+                    continue;
+                }
+
+                snapshot_field_t field;
+                field.section.type = FieldSection;
+                field.section.uid = uid;
+                field.section.nid = node.nid;
+                field.section.fid = fid;
+                field.section.ftype = srcfield->type;
+
+                // values that haven't been read since a lazy open are copied as is
+                field.stored = lazy_section(uid,fid);
+                field.saved.lazy = field.stored;
+
+                // what the last save wrote for the field, big values that
+                // haven't changed since are left where they are
+                auto it = saved.fields.find(field_key(uid,fid));
+                if(snapshot.incremental && it != saved.fields.end() && is_big(srcfield->type)
+                        && it->second.section.ftype == uint32_t(srcfield->type)
+                        && it->second.lazy == field.stored) {
+                    field.last = it->second;
+                    field.has_last = true;
+                }
+
+                if(field.stored && field.has_last) {
+                    field.unchanged = true;
+                    field.section.flags = field.last.section.flags;
+                    field.section.offset = field.last.section.offset;
+                    field.section.size = field.last.section.size;
+                    field.saved.hash = field.last.hash;
+                } else if(field.stored) {
+                    field.section.flags = field.stored->flags;
+                    snapshot.bytes += field.stored->size;
+                } else if(is_big(srcfield->type)) {
+                    // the scene won't change under a save on the caller's thread
+                    if(snapshot.background)
+                        field.value = copy_big(srcfield);
+                    else
+                        field.value = std::shared_ptr<const void>(big_value(srcfield), [] (const void*) { });
+                } else {
+                    field.data = std::make_shared<io::write_buffer>();
+                    if(!put_field(*field.data,srcfield)) {
+                        snapshot.skipped++;
+                        continue;
+                    }
+                    snapshot.bytes += field.data->size();
+                }
+
+                snapshot.fields.push_back(field);
+            }
+        }
+    }
+
+    // Hashes and encodes the big values taken by take_snapshot(), this
+    // doesn't touch the scene so it can run on the save's thread. Values
+    // that hash the same as the last save's aren't encoded.
+    void prepare_snapshot(snapshot_t& snapshot)
+    {
+        for(auto& field : snapshot.fields) {
+            if(!field.value)
+                continue;
+
+            uint32_t type = field.section.ftype;
+            field.saved.hash = hash_big(type,field.value.get());
+
+            if(field.has_last && field.last.hash == field.saved.hash) {
+                field.unchanged = true;
+                field.section.flags = field.last.section.flags;
+                field.section.offset = field.last.section.offset;
+                field.section.size = field.last.section.size;
+            } else {
+                field.data = std::make_shared<io::write_buffer>();
+                put_big(*field.data,type,field.value.get());
+                snapshot.bytes += field.data->size();
+            }
+
+            field.value.reset();
+        }
+    }
+
+    // Writes the snapshot to it's file, this doesn't touch the scene so it
+    // can run on it's own thread. The mutex is taken at the end to
+    // remember what was saved.
+    status write_snapshot(snapshot_t& snapshot, const save_callback& callback)
+    {
+        prepare_snapshot(snapshot);
+
+        // A full save is written next to the old file and moved over it at
+        // the end, a lazy open could still have the old one mapped. An
+        // incremental save adds the new sections and section table to the
+        // end of the file, the old table is used until the header is updated.
+        std::string tempname = snapshot.incremental ? snapshot.filename : snapshot.filename + ".tmp";
+        std::fstream file;
+        if(snapshot.incremental)
+            file.open(tempname,std::ios_base::in|std::ios_base::out|std::ios_base::binary);
+        else
+            file.open(tempname,std::ios_base::out|std::ios_base::binary|std::ios_base::trunc);
+        if(!file.is_open())
+            return status(FAILED,"can't write " + tempname);
+
+        // the header and section table's offset are written once the sections are
+        toc_t toc = toc_t();
+        uint64_t offset = sizeof(header_t) + sizeof(toc_t);
+        if(snapshot.incremental) {
+            offset = io::padded(snapshot.end,section_align);
+            file.seekp(snapshot.end);
+            for(uint64_t i=snapshot.end; i < offset; i++)
+                file.put('\0');
+        } else {
+            file.write((char*)&snapshot.header,sizeof(header_t));
+            file.write((char*)&toc,sizeof(toc));
+        }
+
+        std::vector<section_t> sections;
+        std::unordered_map<uint64_t,saved_field_t> written;
+
+        // WRITE NODES
+        section_t section = section_t();
+        section.type = NodeSection;
+        write_section(file,snapshot.nodes.data(),snapshot.nodes.size(),section,offset,sections);
+
+        // WRITE LINKS
+        section.type = LinkSection;
+        write_section(file,(char*)snapshot.links.data(),snapshot.links.size()*sizeof(link_t),section,offset,sections);
+
+        // WRITE FIELD DATA
+        io::write_buffer packed;
+        unsigned int unchanged = 0;
+        uint64_t done = 0;
+        int reported = 0;
+        for(auto& field : snapshot.fields) {
+            uint64_t key = field_key(field.section.uid,field.section.fid);
+
+            if(field.unchanged) {
+                sections.push_back(field.section);
+                field.saved.section = field.section;
+                written[key] = field.saved;
+                unchanged++;
+                continue;
+            }
+
+            if(field.stored) {
+                write_section(file,snapshot.lazyfile->data(*field.stored),field.stored->size,field.section,offset,sections);
+                done += field.stored->size;
+            } else if(snapshot.compress && field.data->size() > block_size) {
+                packed.clear();
+                compress(*field.data,snapshot.filter,snapshot.threads,packed);
+                field.section.flags = Compressed;
+                write_section(file,packed.data(),packed.size(),field.section,offset,sections);
+                done += field.data->size();
+            } else {
+                write_section(file,field.data->data(),field.data->size(),field.section,offset,sections);
+                done += field.data->size();
+            }
+
+            // the copy isn't needed once it's written
+            field.data.reset();
+
+            field.saved.section = sections.back();
+            written[key] = field.saved;
+
+            int percent = snapshot.bytes ? int(100*done/snapshot.bytes) : 100;
+            if(callback && percent > reported) {
+                reported = percent;
+                callback(percent/100.0f,false,status());
+            }
+        }
+
+        // WRITE SECTION TABLE
+        toc.offset = offset;
+        toc.count = sections.size();
+        file.write((char*)sections.data(),sections.size()*sizeof(section_t));
+
+        // the new sections have to be in the file before the header points to them
+        file.flush();
+        file.seekp(0);
+        file.write((char*)&snapshot.header,sizeof(header_t));
+        file.write((char*)&toc,sizeof(toc));
+        file.close();
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if(file.fail() || (!snapshot.incremental && std::rename(tempname.c_str(),snapshot.filename.c_str()))) {
+            if(!snapshot.incremental)
+                std::remove(tempname.c_str());
+            saved.clear();
+            return status(FAILED,"failed to write " + snapshot.filename);
+        }
+
+        std::cout << "wrote " << snapshot.node_count << " nodes, "
+            << snapshot.links.size() << " links and "
+            << snapshot.fields.size() - unchanged << " fields";
+        if(snapshot.incremental)
+            std::cout << ", " << unchanged << " fields were unchanged";
+        std::cout << std::endl;
+
+        if(snapshot.skipped)
+            std::cout << snapshot.skipped << " fields have a type that can't be saved\n";
+
+        saved.filename = snapshot.filename;
+        saved.end = offset + sections.size()*sizeof(section_t);
+        saved.fields.swap(written);
+
+        return status();
     }
 
-    std::cout << "write file end\n";
+    // The save running in the background. It's joined before the plugin
+    // is unloaded so the thread isn't left running.
+    struct background_t {
+        std::thread thread;
+        status result;
 
-    // terminating string to verify the file saved correctly
-    file.write("<eof>",6);
- 
-    file.close();
+        void wait() {
+            if(thread.joinable())
+                thread.join();
+        };
+
+        ~background_t() { wait(); };
+    };
+
+    background_t background;
+
+} // namespace
+
+
+status io::feather_format::reader::open(std::string filename)
+{
+    _section.clear();
+    _field.clear();
+
+    if(!_file.open(filename))
+        return status(FAILED,"can't open " + filename);
+
+    if(_file.size() < sizeof(header_t))
+        return status(FAILED,"feather file is too short");
+
+    memcpy(&_header, _file.data(), sizeof(header_t));
+
+    // 0.1 files don't have a section table
+    if(_header.major != version_major)
+        return status();
+
+    toc_t toc;
+    if(_file.size() < sizeof(header_t) + sizeof(toc_t))
+        return status(FAILED,"feather file is too short");
+    memcpy(&toc, _file.data() + sizeof(header_t), sizeof(toc_t));
+
+    if(toc.offset > _file.size() || (_file.size() - toc.offset) / sizeof(section_t) < toc.count)
+        return status(FAILED,"feather section table is truncated");
+
+    _section.resize(toc.count);
+    memcpy(_section.data(), _file.data() + toc.offset, toc.count*sizeof(section_t));
+
+    for(uint32_t i=0; i < toc.count; i++) {
+        const section_t& section = _section[i];
+        if(section.offset > _file.size() || section.size > _file.size() - section.offset)
+            return status(FAILED,"feather section is past the end of the file");
+        if(section.type == FieldSection)
+            _field[field_key(section.uid,section.fid)] = i;
+    }
+
+    return status();
+}
+
+
+const section_t* io::feather_format::reader::find(uint32_t uid, uint32_t fid) const
+{
+    auto it = _field.find(field_key(uid,fid));
+    return it == _field.end() ? nullptr : &_section[it->second];
+}
+
+
+bool io::feather_format::open(std::string filename, bool lazyopen) {
+    std::cout << "OPEN FEATHER FILE\n";
+
+    // a save still writing the last scene has to finish first
+    background.wait();
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // anything left from the last file won't be needed
+    lazy.clear();
+    saved.clear();
+
+    // the whole file is mapped and read in place
+    std::shared_ptr<reader> file = std::make_shared<reader>();
+    status s = file->open(filename);
+    if(s.state == FAILED) {
+        std::cout << "error loading \"" << filename << "\" feather file: " << s.msg << std::endl;
+        return false;
+    }
+
+    const header_t& header = file->header();
+
+    std::cout << "version = " << header.major << "." << header.minor << std::endl
+        << "sframe = " << header.stime << std::endl
+        << "eframe = " << header.etime << std::endl
+        << "cframe = " << header.ctime << std::endl
+        << "fps = " << header.fps << std::endl;
+
+    if(header.major == 0 && header.minor == 1) {
+        // clear out the scenegraph
+        plugin::clear();
+        cursor_t c(file->begin() + sizeof(header_t), file->end());
+        return open_0_1(c);
+    }
+
+    if(header.major != version_major) {
+        std::cout << "unknown feather file version\n";
+        return false;
+    }
+
+    if(lazyopen)
+        lazy.file = file;
+
+    // clear out the scenegraph
+    plugin::clear();
+    return open_2_0(file,filename);
+}
+
+
+unsigned int io::feather_format::load(unsigned int uid)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    unsigned int loaded = 0;
+    std::vector<uint32_t> nodes(1,uid);
+    std::unordered_map<uint32_t,bool> visited;
+
+    // walk up the links so everything the node is computed from is read
+    while(!nodes.empty() && lazy.count) {
+        uint32_t node = nodes.back();
+        nodes.pop_back();
+        if(visited[node])
+            continue;
+        visited[node] = true;
+
+        loaded += load_node(node);
+
+        auto range = lazy.inputs.equal_range(node);
+        for(auto it = range.first; it != range.second; ++it)
+            nodes.push_back(it->second);
+    }
+
+    return loaded;
+}
+
+
+unsigned int io::feather_format::load()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<uint32_t> nodes;
+    for(auto& node : lazy.fields)
+        nodes.push_back(node.first);
+
+    unsigned int loaded = 0;
+    for(uint32_t node : nodes)
+        loaded += load_node(node);
+
+    return loaded;
+}
+
+
+unsigned int io::feather_format::pending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return lazy.count;
+}
+
+
+bool io::feather_format::save(std::string filename, bool compressed, unsigned int filter, unsigned int threads, bool incremental) {
+    std::cout << "SAVE FILE\n";
+
+    // only one save can write at a time
+    background.wait();
+
+    snapshot_t snapshot;
+    snapshot.filename = filename;
+    snapshot.compress = compressed;
+    snapshot.filter = filter;
+    snapshot.threads = threads;
+    snapshot.incremental = incremental;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        take_snapshot(snapshot);
+    }
+
+    status s = write_snapshot(snapshot,save_callback());
+    if(s.state == FAILED) {
+        std::cout << s.msg << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+void io::feather_format::save_async(std::string filename, bool compressed, unsigned int filter, unsigned int threads, bool incremental, save_callback callback) {
+    std::cout << "SAVE FILE IN THE BACKGROUND\n";
+
+    // only one save can write at a time
+    background.wait();
+
+    std::shared_ptr<snapshot_t> snapshot = std::make_shared<snapshot_t>();
+    snapshot->filename = filename;
+    snapshot->compress = compressed;
+    snapshot->filter = filter;
+    snapshot->threads = threads;
+    snapshot->incremental = incremental;
+    snapshot->background = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        take_snapshot(*snapshot);
+    }
+
+    background.result = status();
+    background.thread = std::thread([snapshot,callback] () {
+            status s = write_snapshot(*snapshot,callback);
+            background.result = s;
+            if(s.state == FAILED)
+                std::cout << s.msg << std::endl;
+            if(callback)
+                callback(1.0f,true,s);
+            });
+}
+
+
+status io::feather_format::wait()
+{
+    background.wait();
+    return background.result;
+}
+
+
+bool io::feather_format::compact(std::string filename) {
+    std::cout << "COMPACT FILE\n";
+
+    background.wait();
+    std::lock_guard<std::mutex> lock(mutex);
+
+    reader file;
+    status s = file.open(filename);
+    if(s.state == FAILED || file.header().major != version_major) {
+        std::cout << "can't compact \"" << filename << "\", it's not a " << version_major << "." << version_minor << " feather file\n";
+        return false;
+    }
+
+    std::string tempname = filename + ".tmp";
+    std::fstream out;
+    out.open(tempname,std::ios_base::out|std::ios_base::binary|std::ios_base::trunc);
+    if(!out.is_open()) {
+        std::cout << "can't write \"" << tempname << "\" feather file\n";
+        return false;
+    }
+
+    toc_t toc = toc_t();
+    out.write((char*)&file.header(),sizeof(header_t));
+    out.write((char*)&toc,sizeof(toc));
+
+    // only the sections in the table are copied, anything left behind by
+    // incremental saves is dropped
+    std::vector<section_t> sections;
+    std::unordered_map<uint64_t,uint64_t> moved;   // old offset to new offset
+    uint64_t offset = sizeof(header_t) + sizeof(toc_t);
+
+    for(auto& section : file.sections()) {
+        moved[section.offset] = offset;
+        write_section(out,file.data(section),section.size,section,offset,sections);
+    }
+
+    toc.offset = offset;
+    toc.count = sections.size();
+    out.write((char*)sections.data(),sections.size()*sizeof(section_t));
+    out.seekp(sizeof(header_t));
+    out.write((char*)&toc,sizeof(toc));
+    out.close();
+
+    if(out.fail() || std::rename(tempname.c_str(),filename.c_str())) {
+        std::cout << "failed to write \"" << filename << "\" feather file\n";
+        std::remove(tempname.c_str());
+        return false;
+    }
+
+    std::cout << "compacted \"" << filename << "\" from " << file.end() - file.begin()
+        << " to " << offset + sections.size()*sizeof(section_t) << " bytes\n";
+
+    // the sections moved so the next incremental save has to know where
+    if(saved.filename == filename) {
+        for(auto& field : saved.fields)
+            field.second.section.offset = moved[field.second.section.offset];
+        saved.end = offset + sections.size()*sizeof(section_t);
+    }
 
     return true;
 }
@@ -27,12 +27,54 @@
 #include <feather/types.hpp>
 #include <feather/deps.hpp>
 #include <feather/status.hpp>
+#include <unordered_map>
+#include <functional>
+#include "mmap.hpp"
 
 namespace io 
 {
 
 /*
- * FEATHER FORMAT
+ * FEATHER FORMAT 2.0
+ *
+ * [header_t]
+ * [toc_t]              // where the section table is
+ * SECTIONS             // each section starts on an 8 byte boundary
+ *      [nodes]         // node_t and name for every node
+ *      [links]         // link_t for every link
+ *      [field data]    // one section for each field value
+ *      ...
+ * SECTION TABLE
+ *      [section_t]     // one for each section, toc_t.count of them
+ *
+ * Every section is listed in the table with it's offset and size so a
+ * node's fields can be found without reading the rest of the file. Field
+ * sections carry the uid, nid, fid and field type of their value.
+ *
+ * FIELD DATA
+ *      fixed size values are stored as they're laid out in memory
+ *      Mesh            [mesh_t][v][st][vn][face sizes][face points]
+ *      IntArray        [count][values]     // same for RealArray and KeyArray
+ *      MeshArray       [count] then each mesh like a Mesh field
+ *      VertexIndiceGroupWeight         [count][weight][vertices]
+ *      VertexIndiceGroupWeightArray    [count] then each group
+ *
+ * Counts are uint32. Large field sections can be saved compressed, they
+ * are split into blocks that are compressed on their own so they can be
+ * packed and unpacked in parallel
+ *
+ * COMPRESSED SECTION
+ *      [block_t]
+ *      [block_size_t]  // one for each block
+ *      [block data]    // zlib data or the block as is if it didn't shrink
+ *
+ * Before a block is compressed it can be delta encoded, each 32 bit word
+ * has the one 12 bytes before it (the size of a vertex or face point)
+ * taken away, and then shuffled so the first byte of every word comes
+ * first, then the second byte, etc. Both make float and index arrays
+ * compress much better.
+ *
+ * Files from 0.1 are still opened, they're laid out as
  *
  * [header_t]
  * [node_count]
@@ -51,10 +93,20 @@ namespace io
  *
  *
  * When opening Feather files all the nodes are created, links made and then values set.
+ * An incremental save appends the values that have changed and a new
+ * section table to the end of the file and then points the header at the
+ * new table. Sections that are no longer in the table stay in the file
+ * until it's compacted.
+ *
+ * A lazy open skips the mesh values, they're read from the file when a
+ * node that uses them is loaded and written straight back out by save().
  */
     namespace feather_format
     {
 
+        const uint32_t version_major = 2;
+        const uint32_t version_minor = 0;
+
         struct header_t {
             uint32_t major; // version number
             uint32_t minor; // version number
@@ -80,6 +132,7 @@ namespace io
             uint32_t tfid;
         };
 
+        // 0.1 field header
         struct field_t {
             uint32_t uid;
             uint32_t nid;
@@ -88,9 +141,115 @@ namespace io
             uint32_t length;
         };
 
-        bool open(std::string filename);
+        struct toc_t {
+            uint64_t offset;    // of the section table
+            uint32_t count;     // sections in the table
+            uint32_t pad;
+        };
+
+        enum SectionType { NodeSection=1, LinkSection=2, FieldSection=3 };
+
+        struct section_t {
+            uint32_t type;      // SectionType
+            uint32_t flags;
+            uint32_t uid;       // the rest are only used by field sections
+            uint32_t nid;
+            uint32_t fid;
+            uint32_t ftype;     // field::Type of the value
+            uint64_t offset;    // from the start of the file
+            uint64_t size;      // bytes in the file
+        };
+
+        enum SectionFlags { Compressed=1 };
+
+        // filters applied to the blocks before they're compressed
+        enum BlockFilter { Shuffle=1, Delta=2 };
+
+        // uncompressed size of a block, the last one can be smaller
+        const uint32_t block_size = 1 << 20;
+
+        struct block_t {
+            uint32_t count;     // blocks
+            uint32_t filter;    // BlockFilter flags
+            uint64_t length;    // uncompressed size of the section
+        };
+
+        struct block_size_t {
+            uint32_t size;      // bytes in the file
+            uint32_t length;    // uncompressed, the same as size if it's stored as is
+        };
+
+        struct mesh_t {
+            uint32_t v;         // vertices
+            uint32_t st;        // texture coords
+            uint32_t vn;        // normals
+            uint32_t f;         // faces
+            uint32_t fp;        // face points
+            uint32_t pad;
+        };
+
+        // Reads the section table of a 2.0 file from a memory mapped file,
+        // the sections are read in place.
+        class reader
+        {
+            public:
+                feather::status open(std::string filename);
+
+                const header_t& header() const { return _header; };
+                const std::vector<section_t>& sections() const { return _section; };
+
+                // section holding a field's value or null if it wasn't saved
+                const section_t* find(uint32_t uid, uint32_t fid) const;
+                const char* data(const section_t& section) const { return _file.data() + section.offset; };
+                const char* begin() const { return _file.begin(); };
+                const char* end() const { return _file.end(); };
+
+            private:
+                mapped_file _file;
+                header_t _header = header_t();
+                std::vector<section_t> _section;
+                std::unordered_map<uint64_t,uint32_t> _field;   // uid and fid to section
+        };
+
+        // A lazy open makes the nodes, links and small values straight away
+        // but leaves Mesh and MeshArray values in the mapped file until
+        // load() reads them. 0.1 files are always read in full.
+        bool open(std::string filename, bool lazy=false);
+
+        // Reads the values a lazy open left in the file for the node and
+        // every node upstream of it. Returns how many fields were read,
+        // they're flagged for update so the graph needs an update after.
+        unsigned int load(unsigned int uid);
+
+        // reads every value left in the file
+        unsigned int load();
+
+        // values still in the file from the last lazy open
+        unsigned int pending();
+
+        // Field values bigger than a block can be compressed with filter
+        // applied to each block first, threads is the number of cores used
+        // to compress them and 0 uses every core.
+        // An incremental save only adds the values that changed since the
+        // last save or open of the same file, the rest of the file is left
+        // as it is. If anything else wrote to the file the whole file is
+        // saved instead.
+        bool save(std::string filename, bool compress=false, unsigned int filter=0, unsigned int threads=0, bool incremental=false);
+
+        // Called from the save thread as the file is written. The last call
+        // has done set and the result of the save.
+        typedef std::function<void(float progress, bool done, feather::status result)> save_callback;
+
+        // Takes a snapshot of the scene and writes it on a background
+        // thread, the scene can be changed as soon as this returns. Starting
+        // another save, open or compact waits for this one to finish.
+        void save_async(std::string filename, bool compress=false, unsigned int filter=0, unsigned int threads=0, bool incremental=false, save_callback callback=save_callback());
+
+        // waits for a background save and returns how it went
+        feather::status wait();
 
-        bool save(std::string filename);
+        // rewrites the file without the old sections incremental saves left
+        bool compact(std::string filename);
 
     } // namespace feather
 
@@ -23,76 +23,60 @@
 
 #include "io.hpp"
 #include <feather/plugin.hpp>
+#include "parallel.hpp"
+#include <algorithm>
+#include <unordered_map>
+#include <limits>
 
 bool io::load_mesh(mesh_t& mesh, std::string path)
 {
+    mesh_format::reader file;
+    feather::status p = file.open(path);
+    if(p.state==feather::FAILED) {
+        std::cout << "Failed to load mesh " << path << ": " << p.msg << std::endl;
+        return false;
+    }
+
+    file.get_vertices(mesh.v);
+    file.get_texture_coords(mesh.st);
+    file.get_normals(mesh.vn);
+    return true;
+}
+
+bool io::load_mesh(feather::FMesh& mesh, std::string path)
+{
+    mesh_format::reader file;
+    feather::status p = file.open(path);
+    if(p.state==feather::FAILED) {
+        std::cout << "Failed to load mesh " << path << ": " << p.msg << std::endl;
+        return false;
+    }
+
+    file.get_mesh(mesh);
     return true;
 }
 
 
 bool io::write_mesh(obj_data_t& data)
 {
-    std::stringstream ss;
-    std::fstream file;
-
     std::cout << "==========================\nExtracting Meshes\n==========================\n";
 
-    for(object_t object : data.object)
+    for(const object_t& object : data.object)
     {
-        // MetaData
-        
+        // each smoothing group is written as a group of faces
+        std::vector<mesh_format::group_info_t> groups;
+        for(const group_t& fg : object.grp)
+            for(const smoothing_group_t& sg : fg.sg)
+                groups.push_back({ fg.usemtl, sg.s, sg.f.data(), sg.f.size() });
+
         std::string filename = object.o + ".mesh";
-        file.open(filename.c_str(),std::ios::out|std::ios::binary);
-        ss << "<meta>name[" << object.o << "]";
-        ss << "v[" << object.mesh.v.size() << "]";
-        ss << "st[" << object.mesh.st.size() << "]";        
-        ss << "vn[" << object.mesh.vn.size() << "]";
-        ss << "groups[" << object.grp.size() << "]";
-
-        for(group_t fg : object.grp)      
-        {
-            ss << "usemtl[" << fg.usemtl << "]";
-            for(smoothing_group_t sg : fg.sg)
-            {
-                ss << "s[" << sg.s << "]";
-                ss << "f[" << sg.f.size() << "]";
-            }
+        feather::status p = mesh_format::write(filename, object.o, object.mesh.v, object.mesh.st, object.mesh.vn, groups);
+        if(p.state==feather::FAILED) {
+            std::cout << "Failed to write " << filename << ": " << p.msg << std::endl;
+            return false;
         }
 
-        ss << "</meta><data>";
-
-        file.write(ss.str().c_str(),ss.tellp());
-
-        for(feather::FVertex3D v : object.mesh.v)
-            file.write((char*)&v, sizeof(feather::FVertex3D));
-
-        for(feather::FTextureCoord st : object.mesh.st)
-            file.write((char*)&st, sizeof(feather::FTextureCoord));
-
-        for(feather::FVertex3D vn : object.mesh.vn)
-            file.write((char*)&vn, sizeof(feather::FVertex3D));
-
-        /*
-        for(group_t group : object.grp)
-            for(std::vector<face_point_t> f : group.f)
-                for(face_point_t fp : f)
-                    file.write((char*)&fp, sizeof(face_point_t));
-        */
-        
-        for(group_t group : object.grp)
-            for(smoothing_group_t sg : group.sg)
-                for(feather::FFace f : sg.f)
-                    for(feather::FFacePoint fp : f)
-                        file.write((char*)&fp, sizeof(feather::FFacePoint));
-
-        ss.seekp(0);
-        ss.clear();
-        ss << "</data>";
-        file.write(ss.str().c_str(),ss.tellp());
-        ss.seekp(0);
-        file.close();
-
-        std::cout << "created " << object.o << ".mesh\n";
+        std::cout << "created " << filename << "\n";
     }    
 
     std::cout << "\nMesh Extraction Complete!\n\n";
@@ -184,50 +168,305 @@ bool io::write_camera_data(std::string filename, unsigned int uid)
     return true;
 }
 
-bool io::write_obj(std::string filename, obj_data_t& data)
+namespace
 {
-    std::stringstream ss;
 
+    // The channels written for every camera, the transform is read from
+    // the camera's outputs and the lens from it's inputs. The plugin api
+    // only gives a node's field ids and not their names, so these are the
+    // ids the camera is built with: 214-219 are the transform outputs
+    // every object node has and 2-4 are the CAMERA node's lens fields in
+    // common/src/main.cpp. write_camera_data() reads the same ids.
+    const io::track_format::channel_info_t camera_channels[] = {
+        { "tx", 214 },
+        { "ty", 215 },
+        { "tz", 216 },
+        { "rx", 217 },
+        { "ry", 218 },
+        { "rz", 219 },
+        { "fov", 2 },
+        { "near", 3 },
+        { "far", 4 }
+    };
+
+} // namespace
+
+feather::status io::export_camera_tracks(std::string filename, const std::vector<unsigned int>& uids, int sframe, int eframe)
+{
+    feather::status p;
+
+    // get the time node
+    typedef feather::field::Field<feather::FReal>* RealType;
+    RealType ctime = static_cast<RealType>(feather::plugin::get_node_field_base(1,3));
+    RealType fps = static_cast<RealType>(feather::plugin::get_node_field_base(1,8));
+
+    std::vector<track_format::channel_info_t> channels(std::begin(camera_channels), std::end(camera_channels));
+    std::vector<std::string> names;
+    // every channel of the first camera, then the next camera
+    std::vector<RealType> fields;
+
+    for(auto uid : uids){
+        std::string name;
+        feather::plugin::get_node_name(uid,name,p);
+        names.push_back(name);
+        // a field that isn't a real on this node is left out
+        for(auto& channel : channels) {
+            feather::field::FieldBase* f = feather::plugin::get_node_field_base(uid,channel.fid);
+            fields.push_back((f && f->type == feather::field::Real) ? static_cast<RealType>(f) : nullptr);
+        }
+    }
+
+    track_format::writer tracks;
+    p = tracks.open(filename,names,channels,fps->value);
+    if(p.state==feather::FAILED)
+        return p;
+
+    std::vector<double> values(fields.size());
+
+    // the graph is only updated once a frame for all the cameras
+    for(int f=sframe; f <= eframe; f++){
+        ctime->value = ( 1.0 / fps->value ) * f;
+        ctime->update = true;
+        feather::plugin::update();
+
+        // cameras without the field get a nan so it's not mistaken for a key
+        for(unsigned int i=0; i < fields.size(); i++)
+            values[i] = fields[i] ? fields[i]->value : std::numeric_limits<double>::quiet_NaN();
+
+        p = tracks.write_frame(f,values);
+        if(p.state==feather::FAILED)
+            return p;
+    }
+
+    return tracks.close();
+}
+
+namespace
+{
+
+    // obj files are written a chunk at a time so large scenes aren't held
+    // in memory, the chunk is big enough that each write is efficient
+    const size_t obj_chunk_size = 4 << 20;
+
+    inline void put_obj_vector(io::write_buffer& buffer, const char* key, size_t length, const feather::FVertex3D& v)
+    {
+        buffer.append(key, length);
+        buffer.put_float(v.x);
+        buffer.put(' ');
+        buffer.put_float(v.y);
+        buffer.put(' ');
+        buffer.put_float(v.z);
+        buffer.put('\n');
+    }
+
+    inline void put_obj_uv(io::write_buffer& buffer, const feather::FTextureCoord& st)
+    {
+        buffer.append("vt ", 3);
+        buffer.put_float(st.s);
+        buffer.put(' ');
+        buffer.put_float(st.t);
+        buffer.put('\n');
+    }
+
+    // the indices are 1 based, a 0 vt or vn isn't written
+    inline void put_obj_facepoint(io::write_buffer& buffer, uint64_t v, uint64_t vt, uint64_t vn)
+    {
+        buffer.put(' ');
+        buffer.put_uint(v);
+        if(vt || vn) {
+            buffer.put('/');
+            if(vt)
+                buffer.put_uint(vt);
+            if(vn) {
+                buffer.put('/');
+                buffer.put_uint(vn);
+            }
+        }
+    }
+
+    void put_obj_line(io::write_buffer& buffer, const char* key, const std::string& value)
+    {
+        buffer.append(key);
+        buffer.put(' ');
+        buffer.append(value);
+        buffer.put('\n');
+    }
+
+} // namespace
+
+bool io::write_obj(std::string filename, obj_data_t& data)
+{
     std::fstream file;
-    file.open(filename.c_str(),std::ios::out|std::ios::binary);
+    file.open(filename.c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
+    if(!file.is_open())
+        return false;
 
-    ss << "# Exported obj from mesh\n";
+    write_buffer buffer;
+    buffer.reserve(obj_chunk_size + 4096);
+    buffer.append("# Exported obj from mesh\n");
 
     // write the mtllib
-    for(std::string mtllib : data.mtllib) 
-        ss << "mtllib " << mtllib << std::endl;
+    for(auto& mtllib : data.mtllib)
+        put_obj_line(buffer, "mtllib", mtllib);
+
+    uint64_t voffset = 1, stoffset = 1, vnoffset = 1;
 
     // for each object
-    for(object_t obj : data.object)
+    for(auto& obj : data.object)
     {
         // object name
-        ss << "o " << obj.o << std::endl;
-        
+        put_obj_line(buffer, "o", obj.o);
+
         // node info
-        ss << "# " << obj.mesh.v.size() << " vertics\n";
+        buffer.append("# ");
+        buffer.put_uint(obj.mesh.v.size());
+        buffer.append(" vertics\n");
+
+        for(auto& v : obj.mesh.v) {
+            put_obj_vector(buffer, "v ", 2, v);
+            if(buffer.size() >= obj_chunk_size)
+                buffer.flush(file);
+        }
 
-        // print vertexs
-        for(feather::FVertex3D v : obj.mesh.v)
-            ss << "v " << v.x << " " << v.y << " " << v.z << std::endl;
+        for(auto& st : obj.mesh.st) {
+            put_obj_uv(buffer, st);
+            if(buffer.size() >= obj_chunk_size)
+                buffer.flush(file);
+        }
 
-        // print tex coords
-        for(feather::FTextureCoord vt : obj.mesh.st)
-            ss << "vt " << vt.s << " " << vt.t << std::endl;
+        for(auto& vn : obj.mesh.vn) {
+            put_obj_vector(buffer, "vn ", 3, vn);
+            if(buffer.size() >= obj_chunk_size)
+                buffer.flush(file);
+        }
 
-        // print normals
-        for(feather::FVertex3D vn : obj.mesh.vn)
-            ss << "vn " << vn.x << " " << vn.y << " " << vn.z << std::endl;
+        if(!obj.g.empty())
+            put_obj_line(buffer, "g", obj.g);
+
+        // the face indices are 0 based and relative to the object
+        bool uvs = !obj.mesh.st.empty();
+        bool normals = !obj.mesh.vn.empty();
+
+        for(auto& grp : obj.grp) {
+            if(!grp.usemtl.empty())
+                put_obj_line(buffer, "usemtl", grp.usemtl);
+
+            for(auto& sg : grp.sg) {
+                if(sg.s) {
+                    buffer.append("s ");
+                    buffer.put_int(sg.s);
+                    buffer.put('\n');
+                } else
+                    buffer.append("s off\n");
+
+                for(auto& f : sg.f) {
+                    buffer.put('f');
+                    for(auto& fp : f)
+                        put_obj_facepoint(buffer, fp.v + voffset, uvs ? fp.vt + stoffset : 0, normals ? fp.vn + vnoffset : 0);
+                    buffer.put('\n');
+                    if(buffer.size() >= obj_chunk_size)
+                        buffer.flush(file);
+                }
+            }
+        }
 
+        voffset += obj.mesh.v.size();
+        stoffset += obj.mesh.st.size();
+        vnoffset += obj.mesh.vn.size();
     }
 
-    file.write(ss.str().c_str(),ss.tellp());
-    ss.seekp(0);
+    buffer.flush(file);
     file.close();
 
-    return true;
+    return !file.fail();
+}
+
+bool io::write_obj(std::string filename, const std::vector<std::string>& names, const std::vector<const feather::FMesh*>& meshes)
+{
+    std::fstream file;
+    file.open(filename.c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
+    if(!file.is_open())
+        return false;
+
+    write_buffer buffer;
+    buffer.reserve(obj_chunk_size + 4096);
+    buffer.append("# Exported obj from Feather3D\n");
+
+    // mesh indices are 0 based and local to the mesh, obj indices are 1
+    // based and global to the file
+    uint64_t voffset = 1, stoffset = 1, vnoffset = 1;
+
+    for(unsigned int i=0; i < meshes.size(); i++)
+    {
+        const feather::FMesh& mesh = *meshes[i];
+        bool uvs = !mesh.st.empty();
+        bool normals = !mesh.vn.empty();
+
+        put_obj_line(buffer, "o", names[i]);
+
+        for(auto& v : mesh.v) {
+            put_obj_vector(buffer, "v ", 2, v);
+            if(buffer.size() >= obj_chunk_size)
+                buffer.flush(file);
+        }
+
+        for(auto& st : mesh.st) {
+            put_obj_uv(buffer, st);
+            if(buffer.size() >= obj_chunk_size)
+                buffer.flush(file);
+        }
+
+        for(auto& vn : mesh.vn) {
+            put_obj_vector(buffer, "vn ", 3, vn);
+            if(buffer.size() >= obj_chunk_size)
+                buffer.flush(file);
+        }
+
+        // meshes don't have materials or smoothing groups, the normals
+        // are written instead
+        for(auto& f : mesh.f) {
+            buffer.put('f');
+            for(auto& fp : f) {
+                if(fp.v >= mesh.v.size() || (uvs && fp.vt >= mesh.st.size()) || (normals && fp.vn >= mesh.vn.size())) {
+                    std::cout << "bad face index in " << names[i] << std::endl;
+                    file.close();
+                    return false;
+                }
+                put_obj_facepoint(buffer, fp.v + voffset, uvs ? fp.vt + stoffset : 0, normals ? fp.vn + vnoffset : 0);
+            }
+            buffer.put('\n');
+            if(buffer.size() >= obj_chunk_size)
+                buffer.flush(file);
+        }
+
+        voffset += mesh.v.size();
+        stoffset += mesh.st.size();
+        vnoffset += mesh.vn.size();
+    }
+
+    buffer.flush(file);
+    file.close();
+
+    return !file.fail();
 }
 
-feather::status io::export_ply(std::string path, bool selected, bool animation, int sframe, int eframe)
+namespace
+{
+
+    // meshes that a lazy feather open left in the file have to be read
+    // in before the shapes using them can be exported
+    void load_geometry(const std::vector<unsigned int>& uids)
+    {
+        unsigned int loaded = 0;
+        for(auto uid : uids)
+            loaded += io::feather_format::load(uid);
+        if(loaded)
+            feather::plugin::update();
+    }
+
+} // namespace
+
+feather::status io::export_obj(std::string filename, bool selected, bool animation, int sframe, int eframe)
 {
     feather::status p;
     std::vector<unsigned int> uids;
@@ -240,6 +479,80 @@ feather::status io::export_ply(std::string path, bool selected, bool animation,
         feather::plugin::get_nodes(uids);
     }
 
+    load_geometry(uids);
+
+    typedef feather::field::Field<feather::FMesh>* MeshType;
+    std::vector<std::string> names;
+    std::vector<const feather::FMesh*> meshes;
+
+    for(auto uid : uids){
+        // for now we are only going to export the mesh out from the shape node
+        if(feather::plugin::get_node_id(uid,p)==320){
+            std::string name;
+            feather::plugin::get_node_name(uid,name,p);
+            MeshType mesh = static_cast<MeshType>(feather::plugin::get_field_base(uid,3));
+            names.push_back(name);
+            meshes.push_back(&mesh->value);
+        }
+    }
+
+    if(!animation) {
+        std::cout << "EXPORTING OBJ " << filename << std::endl;
+        if(!io::write_obj(filename,names,meshes))
+            return feather::status(feather::FAILED,"Failed to export obj file.");
+        return p;
+    }
+
+    // get the time node
+    typedef feather::field::Field<feather::FReal>* RealType;
+    RealType ctime = static_cast<RealType>(feather::plugin::get_node_field_base(1,3));
+    RealType fps = static_cast<RealType>(feather::plugin::get_node_field_base(1,4));
+
+    // each frame goes in it's own file with the frame before the extension
+    std::string base = filename;
+    std::string ext = ".obj";
+    size_t dot = filename.find_last_of('.');
+    if(dot != std::string::npos && filename.find('/',dot) == std::string::npos) {
+        base = filename.substr(0,dot);
+        ext = filename.substr(dot);
+    }
+
+    while ( sframe <= eframe ){
+        std::cout << "EXPORTING ANIMATED OBJ FRAME:" << sframe << std::endl;
+        ctime->value = ( 1.0 / fps->value ) * sframe;
+        ctime->update = true;
+        feather::plugin::update();
+
+        std::stringstream framename;
+        framename << base << "." << sframe << ext;
+        if(!io::write_obj(framename.str(),names,meshes)) {
+            std::stringstream ss;
+            ss << "Failed to export " << framename.str() << " to obj format.";
+            std::cout << ss.str() << std::endl;
+            return feather::status(feather::FAILED,ss.str().c_str());
+        }
+
+        sframe++;
+    }
+
+    return p;
+}
+
+feather::status io::export_ply(std::string path, bool selected, bool animation, int sframe, int eframe, bool binary, bool indexed, unsigned int threads)
+{
+    feather::status p;
+    std::vector<unsigned int> uids;
+
+    if(selected){
+        // only export selected shapes
+        uids = feather::plugin::get_selected_nodes();
+    } else {
+        // export all polygon shape nodes
+        feather::plugin::get_nodes(uids);
+    }
+
+    load_geometry(uids);
+
     // get the time node
     typedef feather::field::Field<feather::FReal>* RealType;
     RealType ctime = static_cast<RealType>(feather::plugin::get_node_field_base(1,3));
@@ -248,38 +561,89 @@ feather::status io::export_ply(std::string path, bool selected, bool animation,
     // setup the animation if animation is set
     if(animation) {
         std::cout << "EXPORTING ANIMATED PLYS\n";
-    
-        while ( sframe <= eframe ){
+
+        // the shapes don't change between frames
+        typedef feather::field::Field<feather::FMesh>* MeshType;
+        std::vector<MeshType> meshes;
+        std::vector<std::string> names;
+
+        for(auto uid : uids){
+            // for now we are only going to export the mesh out from the shape node
+            if(feather::plugin::get_node_id(uid,p)==320){
+                std::string name;
+                feather::plugin::get_node_name(uid,name,p);
+                std::cout << "exporting uid:" << uid << " name:" << name << " to path:" << path << std::endl;
+                meshes.push_back(static_cast<MeshType>(feather::plugin::get_field_base(uid,3)));
+                names.push_back(name);
+            }
+        }
+
+        // The graph is evaluated on this thread while a pool of writers
+        // formats and writes the frames before it. The queue holds copies
+        // of the meshes so the graph can move on to the next frame, it's
+        // kept short so memory use doesn't grow with the frame range.
+        struct ply_job_t {
+            std::string name;
+            feather::FMesh mesh;
+        };
+
+        unsigned int writers = thread_count(threads);
+        bounded_queue<ply_job_t> queue(writers*2);
+        std::atomic<bool> failed(false);
+        std::mutex error_mutex;
+        std::string error;
+
+        std::vector<std::thread> pool;
+        for(unsigned int i=0; i < writers; i++) {
+            pool.push_back(std::thread([&] () {
+                        write_buffer buffer;
+                        ply_job_t job;
+                        while(queue.pop(job)) {
+                            // drain the queue after a failure
+                            if(failed)
+                                continue;
+                            if(!io::write_ply(path,job.name,&job.mesh,binary,indexed,buffer)) {
+                                std::lock_guard<std::mutex> lock(error_mutex);
+                                if(!failed)
+                                    error = job.name;
+                                failed = true;
+                            }
+                        }
+                        }));
+        }
+
+        while ( sframe <= eframe && !failed ){
             std::cout << "EXPORTING ANIMATED PLYS FRAME:" << sframe << std::endl;
             ctime->value = ( 1.0 / fps->value ) * sframe;
             ctime->update = true;
             feather::plugin::update();
 
-            for(auto uid : uids){
-                std::cout << "uid:" << uid << " type:" << feather::plugin::get_node_id(uid,p) << std::endl;
-                // for now we are only going to export the mesh out from the shape node
-                if(feather::plugin::get_node_id(uid,p)==320){
-                    typedef feather::field::Field<feather::FMesh>* MeshType;
-                    MeshType mesh = static_cast<MeshType>(feather::plugin::get_field_base(uid,3));
-                    std::string name;
-                    feather::plugin::get_node_name(uid,name,p);
-                    std::cout << "exporting uid:" << uid << " name:" << name << " to path:" << path << std::endl;
-                    std::stringstream filename;
-                    filename << name << "." << sframe;
-                    bool pass = io::write_ply(path,filename.str(),&mesh->value);
-                    if(!pass) {
-                        std::stringstream ss;
-                        ss << "Failed to export " << name << " to ply format.";
-                        std::cout << ss.str() << std::endl;
-                        return feather::status(feather::FAILED,ss.str().c_str());
-                    }
-                }
+            for(unsigned int i=0; i < meshes.size(); i++){
+                std::stringstream filename;
+                filename << names[i] << "." << sframe;
+                ply_job_t job;
+                job.name = filename.str();
+                job.mesh = meshes[i]->value;
+                queue.push(std::move(job));
             }
 
             sframe++;
-        } 
+        }
+
+        queue.close();
+        for(auto& t : pool)
+            t.join();
+
+        if(failed) {
+            std::stringstream ss;
+            ss << "Failed to export " << error << " to ply format.";
+            std::cout << ss.str() << std::endl;
+            return feather::status(feather::FAILED,ss.str().c_str());
+        }
     } else {
         std::cout << "EXPORTING PLYS\n";
+        // every file is built in the same buffer
+        write_buffer buffer;
  
         for(auto uid : uids){
             std::cout << "uid:" << uid << " type:" << feather::plugin::get_node_id(uid,p) << std::endl;
@@ -290,7 +654,7 @@ feather::status io::export_ply(std::string path, bool selected, bool animation,
                 std::string name;
                 feather::plugin::get_node_name(uid,name,p);
                 std::cout << "exporting uid:" << uid << " name:" << name << " to path:" << path << std::endl;
-                bool pass = io::write_ply(path,name,&mesh->value);
+                bool pass = io::write_ply(path,name,&mesh->value,binary,indexed,buffer);
                 if(!pass) {
                     std::stringstream ss;
                     ss << "Failed to export " << name << " to ply format.";
@@ -305,88 +669,368 @@ feather::status io::export_ply(std::string path, bool selected, bool animation,
     return p;
 }
 
-bool io::write_ply(std::string path, std::string name, feather::FMesh* mesh)
+bool io::write_ply(std::string path, std::string name, feather::FMesh* mesh, bool binary, bool indexed)
+{
+    write_buffer buffer;
+    return write_ply(path,name,mesh,binary,indexed,buffer);
+}
+
+bool io::write_ply(std::string path, std::string name, feather::FMesh* mesh, bool binary, bool indexed, write_buffer& buffer)
 {
-    std::fstream file;
     std::stringstream filepath;
     filepath << path << name << ".ply";
-    file.open(filepath.str().c_str(),std::ios::out|std::ios::binary);
 
-    std::stringstream ss;
-    std::stringstream sv;
-    std::stringstream sf;
-
-    unsigned int cfp = 0;
-    for(auto f : mesh->f){
-        unsigned int fpcount = 0;
-            for(auto fp : f){
-                sv << mesh->v.at(fp.v).x << " " 
-                    << mesh->v.at(fp.v).y << " " 
-                    << mesh->v.at(fp.v).z << " " 
-                    ;
-                if(mesh->vn.size()){
-                    sv << mesh->vn.at(fp.vn).x << " " 
-                        << mesh->vn.at(fp.vn).y << " " 
-                        << mesh->vn.at(fp.vn).z << " "
-                        ; 
-                }
+    if(!format_ply(*mesh,binary,indexed,buffer)) {
+        std::cout << "bad face index in " << name << std::endl;
+        return false;
+    }
+
+    return buffer.write(filepath.str());
+}
 
-                if(mesh->st.size()>fp.vt && mesh->st.size() > 0){
-                    sv << mesh->st.at(fp.vt).s << " " 
-                        << mesh->st.at(fp.vt).t
-                        ;
-                } 
-                else if(mesh->st.size()<=fp.vt && mesh->st.size() != 0){
-                    sv << "0 0";
+namespace
+{
+
+    const uint32_t no_index = 0xffffffff;
+
+    struct facepoint_hash {
+        size_t operator()(const feather::FFacePoint& fp) const {
+            uint64_t h = fp.v;
+            h = h * 0x9e3779b97f4a7c15ULL ^ fp.vt;
+            h = h * 0x9e3779b97f4a7c15ULL ^ fp.vn;
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+
+    struct facepoint_equal {
+        bool operator()(const feather::FFacePoint& a, const feather::FFacePoint& b) const {
+            return a.v == b.v && a.vt == b.vt && a.vn == b.vn;
+        }
+    };
+
+    // Writes one ply vertex. A vt or vn of no_index, or a vt out of range,
+    // is written as zeros.
+    void put_ply_vertex(const feather::FMesh& mesh, const feather::FFacePoint& fp, bool normals, bool uvs, bool binary, io::write_buffer& buffer)
+    {
+        const feather::FVertex3D& v = mesh.v[fp.v];
+        feather::FVertex3D vn = (normals && fp.vn != no_index) ? mesh.vn[fp.vn] : feather::FVertex3D();
+        feather::FTextureCoord st = (uvs && fp.vt < mesh.st.size()) ? mesh.st[fp.vt] : feather::FTextureCoord();
+
+        if(binary) {
+            buffer.put_binary<float>(v.x);
+            buffer.put_binary<float>(v.y);
+            buffer.put_binary<float>(v.z);
+            if(normals) {
+                buffer.put_binary<float>(vn.x);
+                buffer.put_binary<float>(vn.y);
+                buffer.put_binary<float>(vn.z);
+            }
+            if(uvs) {
+                buffer.put_binary<float>(st.s);
+                buffer.put_binary<float>(st.t);
+            }
+        } else {
+            buffer.put_float(v.x);
+            buffer.put(' ');
+            buffer.put_float(v.y);
+            buffer.put(' ');
+            buffer.put_float(v.z);
+            if(normals) {
+                buffer.put(' ');
+                buffer.put_float(vn.x);
+                buffer.put(' ');
+                buffer.put_float(vn.y);
+                buffer.put(' ');
+                buffer.put_float(vn.z);
+            }
+            if(uvs) {
+                buffer.put(' ');
+                buffer.put_float(st.s);
+                buffer.put(' ');
+                buffer.put_float(st.t);
+            }
+            buffer.put('\n');
+        }
+    }
+
+} // namespace
+
+bool io::format_ply(const feather::FMesh& mesh, bool binary, bool indexed, write_buffer& buffer)
+{
+    bool normals = !mesh.vn.empty();
+    bool uvs = !mesh.st.empty();
+
+    // check the indices and count the face points
+    size_t cfp = 0;
+    size_t largest = 0;
+    for(auto& f : mesh.f) {
+        for(auto& fp : f)
+            if(fp.v >= mesh.v.size() || (normals && fp.vn >= mesh.vn.size()))
+                return false;
+        cfp += f.size();
+        largest = std::max(largest, f.size());
+    }
+
+    // binary face sizes are a uchar unless a face has more points than
+    // that can hold
+    bool wide = largest > 255;
+
+    // Indexed meshes only write each (v,vt,vn) once. If every vertex
+    // always has the same vt and vn there are no seams and the mesh's
+    // own vertices are written, otherwise the face points are welded.
+    bool direct = false;
+    std::vector<feather::FFacePoint> unique;
+    std::vector<uint32_t> index;
+
+    if(indexed) {
+        direct = true;
+        unique.assign(mesh.v.size(), feather::FFacePoint(0, no_index, no_index));
+        for(uint32_t i=0; i < unique.size(); i++)
+            unique[i].v = i;
+
+        for(auto& f : mesh.f) {
+            for(auto& fp : f) {
+                feather::FFacePoint& u = unique[fp.v];
+                uint32_t vt = uvs ? fp.vt : no_index;
+                uint32_t vn = normals ? fp.vn : no_index;
+                if(u.vt == no_index && u.vn == no_index) {
+                    u.vt = vt;
+                    u.vn = vn;
+                } else if(u.vt != vt || u.vn != vn) {
+                    direct = false;
+                    break;
                 }
-                sv << std::endl;
-                ++fpcount;
             }
-        sf << fpcount;
-        for(unsigned int i=0; i < fpcount; i++){
-            sf << " " << cfp;
-            ++cfp;
-        }
-        sf << std::endl;
-    }
-
-    // write file
-    ss << "ply\n"
-        << "format ascii 1.0\n"
-        << "comment Created by Feather3D\n"
-        << "element vertex " << cfp << std::endl
-        << "property float x\n"
-        << "property float y\n"
-        << "property float z\n"
-        ;
+            if(!direct)
+                break;
+        }
 
-    if(mesh->vn.size()){
-        ss << "property float nx\n"
-            << "property float ny\n"
-            << "property float nz\n"
-            ;
+        if(!direct) {
+            std::unordered_map<feather::FFacePoint,uint32_t,facepoint_hash,facepoint_equal> weld;
+            weld.reserve(mesh.v.size() * 2);
+            unique.clear();
+            index.reserve(cfp);
+
+            for(auto& f : mesh.f) {
+                for(auto& fp : f) {
+                    feather::FFacePoint key(fp.v, uvs ? fp.vt : no_index, normals ? fp.vn : no_index);
+                    auto it = weld.insert(std::make_pair(key, static_cast<uint32_t>(unique.size())));
+                    if(it.second)
+                        unique.push_back(key);
+                    index.push_back(it.first->second);
+                }
+            }
+        }
     }
 
-    if(mesh->st.size()){
-        ss << "property float s\n"
-            << "property float t\n"
-            ;
+    // every face point is written as it's own vertex unless it's indexed
+    size_t vertices = indexed ? unique.size() : cfp;
+
+    // floats per vertex
+    size_t stride = 3 + (normals ? 3 : 0) + (uvs ? 2 : 0);
+
+    buffer.clear();
+    if(binary)
+        buffer.reserve(256 + (vertices * stride + cfp) * 4 + mesh.f.size() * (wide ? 4 : 1));
+    else
+        buffer.reserve(256 + vertices * stride * 10 + cfp * 8);
+
+    // header
+    buffer.append("ply\n");
+    buffer.append(binary ? "format binary_little_endian 1.0\n" : "format ascii 1.0\n");
+    buffer.append("comment Created by Feather3D\n");
+    buffer.append("element vertex ");
+    buffer.put_uint(vertices);
+    buffer.append("\nproperty float x\nproperty float y\nproperty float z\n");
+
+    if(normals)
+        buffer.append("property float nx\nproperty float ny\nproperty float nz\n");
+
+    if(uvs)
+        buffer.append("property float s\nproperty float t\n");
+
+    buffer.append("element face ");
+    buffer.put_uint(mesh.f.size());
+    buffer.append(wide ? "\nproperty list uint uint vertex_indices\nend_header\n" : "\nproperty list uchar uint vertex_indices\nend_header\n");
+
+    // vertices
+    if(indexed) {
+        for(auto& u : unique)
+            put_ply_vertex(mesh, u, normals, uvs, binary, buffer);
+    } else {
+        for(auto& f : mesh.f)
+            for(auto& fp : f)
+                put_ply_vertex(mesh, fp, normals, uvs, binary, buffer);
     }
 
-    ss << "element face " << mesh->f.size() << std::endl
-        << "property list uchar uint vertex_indices\n"
-        << "end_header\n"
-        << sv.str()
-        << sf.str()
-        ; 
+    // faces, unless the mesh is indexed the face points were written in
+    // order so the indices just count up
+    uint32_t n = 0;
+    for(auto& f : mesh.f) {
+        if(binary && wide)
+            buffer.put_binary<uint32_t>(f.size());
+        else if(binary)
+            buffer.put_binary<uint8_t>(f.size());
+        else
+            buffer.put_uint(f.size());
+
+        for(auto& fp : f) {
+            uint32_t i = direct ? fp.v : indexed ? index[n] : n;
+            ++n;
+            if(binary)
+                buffer.put_binary<uint32_t>(i);
+            else {
+                buffer.put(' ');
+                buffer.put_uint(i);
+            }
+        }
 
-    file.write(ss.str().c_str(),ss.tellp());
-    ss.seekp(0);
-    file.close();
+        if(!binary)
+            buffer.put('\n');
+    }
 
     return true;
 }
 
+feather::status io::export_cache(std::string filename, bool selected, int sframe, int eframe, bool normals)
+{
+    feather::status p;
+    std::vector<unsigned int> uids;
+
+    if(selected){
+        // only export selected shapes
+        uids = feather::plugin::get_selected_nodes();
+    } else {
+        // export all polygon shape nodes
+        feather::plugin::get_nodes(uids);
+    }
+
+    load_geometry(uids);
+
+    // get the time node
+    typedef feather::field::Field<feather::FReal>* RealType;
+    RealType ctime = static_cast<RealType>(feather::plugin::get_node_field_base(1,3));
+    RealType fps = static_cast<RealType>(feather::plugin::get_node_field_base(1,4));
+
+    typedef feather::field::Field<feather::FMesh>* MeshType;
+    std::vector<MeshType> meshes;
+    std::vector<std::string> names;
+
+    for(auto uid : uids){
+        // for now we are only going to export the mesh out from the shape node
+        if(feather::plugin::get_node_id(uid,p)==320){
+            std::string name;
+            feather::plugin::get_node_name(uid,name,p);
+            meshes.push_back(static_cast<MeshType>(feather::plugin::get_field_base(uid,3)));
+            names.push_back(name);
+        }
+    }
+
+    cache_format::writer cache;
+    p = cache.open(filename,normals,fps->value);
+    if(p.state==feather::FAILED)
+        return p;
+
+    std::vector<const feather::FMesh*> frame;
+
+    for(int f=sframe; f <= eframe; f++){
+        std::cout << "EXPORTING CACHE FRAME:" << f << std::endl;
+        ctime->value = ( 1.0 / fps->value ) * f;
+        ctime->update = true;
+        feather::plugin::update();
+
+        // the topology is taken from the first frame
+        if(f==sframe) {
+            for(unsigned int i=0; i < meshes.size(); i++) {
+                p = cache.add_shape(names[i],meshes[i]->value);
+                if(p.state==feather::FAILED)
+                    return p;
+                frame.push_back(&meshes[i]->value);
+            }
+        }
+
+        p = cache.write_frame(f,frame);
+        if(p.state==feather::FAILED) {
+            std::cout << "Failed to export cache frame " << f << ": " << p.msg << std::endl;
+            return p;
+        }
+    }
+
+    return cache.close();
+}
+
+feather::status io::import_cache(std::string filename, int frame)
+{
+    feather::status p;
+    cache_format::reader cache;
+
+    p = cache.open(filename);
+    if(p.state==feather::FAILED) {
+        std::cout << "Failed to load cache " << filename << ": " << p.msg << std::endl;
+        return p;
+    }
+
+    int index = cache.find_frame(frame);
+    if(index < 0) {
+        std::stringstream ss;
+        ss << "frame " << frame << " isn't in the cache";
+        return feather::status(feather::FAILED,ss.str().c_str());
+    }
+
+    typedef feather::field::Field<feather::FMesh>* sourcefield;
+
+    for(unsigned int i=0; i < cache.shape_count(); i++) {
+        std::string name = cache.name(i);
+
+        // The cache has the names of the shape nodes, the frame is played
+        // into the mesh node connected to the shape if it's already there.
+        unsigned int meshuid = 0;
+        bool found = false;
+        unsigned int shapeuid = 0;
+        if(feather::plugin::get_node_by_name(name,shapeuid) && feather::plugin::get_node_id(shapeuid,p)==320) {
+            feather::field::FieldBase* meshIn = feather::plugin::get_field_base(shapeuid,1);
+            if(meshIn && meshIn->connected()) {
+                meshuid = meshIn->connections.at(0).puid;
+                found = feather::plugin::get_node_id(meshuid,p)==324;
+            }
+        }
+
+        if(!found) {
+            meshuid = feather::plugin::add_node(324,name+"_mesh",p);
+            shapeuid = feather::plugin::add_node(320,name,p);
+            feather::plugin::connect(0,202,meshuid,201);
+            feather::plugin::connect(meshuid,202,shapeuid,201);
+            feather::plugin::connect(meshuid,2,shapeuid,1);
+        }
+
+        sourcefield sf = static_cast<sourcefield>(feather::plugin::get_field_base(meshuid,324,1,0));
+        if(!sf) {
+            std::cout << "NULL SOURCE FIELD\n";
+            continue;
+        }
+
+        // the faces only need to be read when the node doesn't already
+        // have the cached topology, the counts tell a different mesh apart
+        size_t facepoints = 0;
+        for(auto& face : sf->value.f)
+            facepoints += face.size();
+
+        if(!found
+                || sf->value.v.size() != cache.vertex_count(i)
+                || sf->value.st.size() != cache.coord_count(i)
+                || sf->value.f.size() != cache.face_count(i)
+                || facepoints != cache.face_point_count(i))
+            cache.get_topology(i,sf->value);
+
+        cache.get_frame(index,i,sf->value);
+        sf->update = true;
+    }
+
+    feather::plugin::update();
+
+    return feather::status();
+}
+
 template <>
 feather::status io::file<io::IMPORT,io::OBJ>(obj_data_t& data, std::string filename)
 {
@@ -484,3 +1128,48 @@ feather::status io::file<io::IMPORT,io::OBJ>(obj_data_t& data, std::string filen
 
     return feather::status(feather::FAILED,"parsing error");
 }
+
+namespace
+{
+
+    // keeps the meshes until they can be moved into the obj data
+    class obj_data_sink : public io::obj_format::mesh_sink_t
+    {
+        public:
+            void object(unsigned int index, const std::string& name, const io::obj_format::object_size_t& size) {
+                names.push_back(name);
+                meshes.push_back(feather::FMesh());
+            };
+
+            feather::FMesh* mesh(unsigned int index) { return &meshes[index]; };
+
+            std::vector<std::string> names;
+            std::deque<feather::FMesh> meshes;
+    };
+
+} // namespace
+
+template <>
+feather::status io::file<io::IMPORT,io::ASSIMP>(obj_data_t& data, std::string filename)
+{
+    obj_data_sink sink;
+    feather::status p = assimp_format::read(filename, sink);
+    if(p.state==feather::FAILED)
+        return p;
+
+    for(unsigned int i=0; i < sink.meshes.size(); i++) {
+        feather::FMesh& mesh = sink.meshes[i];
+        object_t object;
+        object.o = sink.names[i];
+        object.mesh.v.swap(mesh.v);
+        object.mesh.st.swap(mesh.st);
+        object.mesh.vn.swap(mesh.vn);
+        object.grp.resize(1);
+        object.grp[0].sg.resize(1);
+        object.grp[0].sg[0].s = 0;
+        object.grp[0].sg[0].f.swap(mesh.f);
+        data.object.push_back(std::move(object));
+    }
+
+    return p;
+}
@@ -32,6 +32,12 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "feather.hpp"
+#include "obj.hpp"
+#include "buffer.hpp"
+#include "cache.hpp"
+#include "track.hpp"
+#include "mesh.hpp"
+#include "assimp.hpp"
 
 
 // Mesh Components
@@ -134,7 +140,8 @@ BOOST_FUSION_ADAPT_STRUCT(
 
         enum FileType { Mesh, Shader, Group, Texture, Light, Camera, Global };
         enum Action { IMPORT, EXPORT };
-        enum Format { OBJ, PLY };
+        // ASSIMP is any format assimp can read, fbx, gltf, dae, stl, ...
+        enum Format { OBJ, PLY, ASSIMP };
 
         namespace parsing 
         {
@@ -241,15 +248,15 @@ BOOST_FUSION_ADAPT_STRUCT(
                     data.name("data");
 
                     // error handling
+                    // only report what failed, printing the rest of the
+                    // input from the error position floods the output on
+                    // large files
                     on_error<fail>
                         (
                          data,
                          std::cout
                          << val("Error! Expecting ")
                          << boost::spirit::_4   // what failed
-                         << val(" here: \"")
-                         << construct<std::string>(boost::spirit::_3, boost::spirit::_2) // interators to error pos, end
-                         << val("\"")
                          << std::endl
                         );
                 }
@@ -274,18 +281,40 @@ BOOST_FUSION_ADAPT_STRUCT(
         }
 
 
+        // reads a .mesh file made by write_mesh() or mesh_format::write()
         bool load_mesh(mesh_t& mesh, std::string path);
+        bool load_mesh(feather::FMesh& mesh, std::string path);
+        // writes each object to name.mesh
         bool write_mesh(obj_data_t& data);
         bool write_camera_data(std::string filename, unsigned int uid);
+        // writes a track for each camera from sframe to eframe, the graph is
+        // evaluated once a frame for every camera
+        feather::status export_camera_tracks(std::string filename, const std::vector<unsigned int>& uids, int sframe, int eframe);
         bool write_obj(std::string filename, obj_data_t& data);
-        feather::status export_ply(std::string path, bool selected, bool animation, int sframe, int eframe);
-        bool write_ply(std::string filename, std::string name, feather::FMesh* meshes);
+        // writes each mesh as an object with the matching name
+        bool write_obj(std::string filename, const std::vector<std::string>& names, const std::vector<const feather::FMesh*>& meshes);
+        // animated exports write a file for each frame, name.frame.obj
+        feather::status export_obj(std::string filename, bool selected, bool animation, int sframe, int eframe);
+        // animations are written on up to threads writers, 0 uses every core
+        feather::status export_ply(std::string path, bool selected, bool animation, int sframe, int eframe, bool binary=false, bool indexed=false, unsigned int threads=0);
+        bool write_ply(std::string filename, std::string name, feather::FMesh* meshes, bool binary=false, bool indexed=false);
+        // reuses the buffer's memory, use this when writing a lot of files
+        bool write_ply(std::string filename, std::string name, feather::FMesh* meshes, bool binary, bool indexed, write_buffer& buffer);
+        // fills the buffer with the whole ply file, false if a face index is bad
+        // indexed writes each (v,vt,vn) once instead of once per face point
+        bool format_ply(const feather::FMesh& mesh, bool binary, bool indexed, write_buffer& buffer);
+        // writes the selected or every shape from sframe to eframe into one point cache
+        feather::status export_cache(std::string filename, bool selected, int sframe, int eframe, bool normals);
+        // sets the mesh nodes to a frame of the cache, the nodes are made if they aren't there
+        feather::status import_cache(std::string filename, int frame);
 
         template <int Action, int Format>
         feather::status file(obj_data_t& data, std::string filename="") { return feather::status(feather::FAILED,"unknown action or format"); };
 
         // specialization
         template <> feather::status file<IMPORT,OBJ>(obj_data_t& data, std::string filename);
+        // each mesh in the file is an object with a single group
+        template <> feather::status file<IMPORT,ASSIMP>(obj_data_t& data, std::string filename);
 
     } // namespace io
 
@@ -35,6 +35,7 @@
 
 #include "io.hpp"
 #include "feather.hpp"
+#include "benchmark.hpp"
 
 #ifdef __cplusplus
 extern "C" {
@@ -61,16 +62,20 @@ namespace feather
 {
     namespace command
     {
-        enum Command { N=0, OPEN_FEATHER, SAVE_FEATHER, IMPORT_OBJ, EXPORT_CAMERA_DATA, EXPORT_OBJ, EXPORT_PLY };
+        enum Command { N=0, OPEN_FEATHER, SAVE_FEATHER, IMPORT_OBJ, EXPORT_CAMERA_DATA, EXPORT_OBJ, EXPORT_PLY, EXPORT_CACHE, IMPORT_CACHE, LOAD_GEOMETRY, COMPACT_FEATHER, EXPORT_CAMERA_TRACKS, IMPORT_FILE, BENCHMARK_IO };
 
         // open feather file
         status open_feather(parameter::ParameterList params) {
             std::string filename;
+            bool lazy = false;
             bool p = false;
             p = params.getParameterValue<std::string>("filename",filename); 
+            // lazy is optional
+            params.getParameterValue<bool>("lazy",lazy);
             std::cout << "open feather filename:" << filename << std::endl; 
 
-            io::feather_format::open(filename);
+            if(!io::feather_format::open(filename,lazy))
+                return status(FAILED,"failed to open feather file");
  
             return status();
         };
@@ -81,11 +86,77 @@ namespace feather
             bool p = false;
             p = params.getParameterValue<std::string>("filename",filename); 
 
-            io::feather_format::save(filename);
+            // the compression parameters are optional
+            bool compress = false;
+            bool shuffle = true;
+            bool delta = false;
+            int threads = 0;
+            bool incremental = false;
+            params.getParameterValue<bool>("compress",compress);
+            params.getParameterValue<bool>("shuffle",shuffle);
+            params.getParameterValue<bool>("delta",delta);
+            params.getParameterValue<int>("threads",threads);
+            params.getParameterValue<bool>("incremental",incremental);
+            bool background = false;
+            params.getParameterValue<bool>("background",background);
+
+            unsigned int filter = 0;
+            if(shuffle)
+                filter |= io::feather_format::Shuffle;
+            if(delta)
+                filter |= io::feather_format::Delta;
+
+            // the file is written on another thread, progress is reported as it goes
+            if(background) {
+                io::feather_format::save_async(filename,compress,filter,std::max(threads,0),incremental,
+                        [filename] (float progress, bool done, status result) {
+                            int percent = int(progress*100);
+                            if(done)
+                                std::cout << "background save of " << filename << (result.state==FAILED ? " failed\n" : " finished\n");
+                            else if(percent % 10 == 0)
+                                std::cout << "saving " << filename << " " << percent << "%\n";
+                        });
+                return status();
+            }
+
+            if(!io::feather_format::save(filename,compress,filter,std::max(threads,0),incremental))
+                return status(FAILED,"failed to save feather file");
             
             return status();
         };
 
+        // rewrite a feather file without the data incremental saves left behind
+        status compact_feather(parameter::ParameterList params) {
+            std::string filename;
+            params.getParameterValue<std::string>("filename",filename); 
+
+            if(!io::feather_format::compact(filename))
+                return status(FAILED,"failed to compact feather file");
+
+            return status();
+        };
+
+        // read in the mesh data a lazy open left in the feather file
+        status load_geometry(parameter::ParameterList params) {
+            bool selection = false;
+            params.getParameterValue<bool>("selection",selection);
+
+            unsigned int loaded = 0;
+            if(selection) {
+                for(unsigned int uid : plugin::get_selected_nodes())
+                    loaded += io::feather_format::load(uid);
+            } else
+                loaded = io::feather_format::load();
+
+            std::cout << "loaded " << loaded << " fields, "
+                << io::feather_format::pending() << " still in the file\n";
+
+            if(loaded)
+                plugin::update();
+
+            return status();
+        };
+
         // this is used to tracking down import issues, will delete later
         void print_data(obj_data_t& data) {
             for_each(data.object.begin(), data.object.end(), [] (object_t& objdata) {
@@ -119,19 +190,9 @@ namespace feather
             );
         };
 
-        // import obj file
-        status import_obj(parameter::ParameterList params) {
+        // import obj file using the spirit grammar
+        status import_obj_spirit(std::string filename) {
             feather::status s;
-            std::string filename;
-            std::vector<unsigned int> uids;
-            bool selection=false;
-            bool p=false;
-            p = params.getParameterValue<std::string>("filename",filename);
-            if(!p)
-                return status(FAILED,"filename parameter failed");
-            p = params.getParameterValue<bool>("selection",selection);
-            if(!p)
-                return status(FAILED,"selection parameter failed");
             
             // load the mesh
             //mesh_t mesh;
@@ -208,6 +269,165 @@ namespace feather
         };
 
 
+        // makes a mesh and shape node for each object the obj reader finds
+        class obj_node_sink : public io::obj_format::mesh_sink_t
+        {
+            public:
+                void object(unsigned int index, const std::string& name, const io::obj_format::object_size_t& size) {
+                    feather::status s;
+                    // add the nodes to the scenegraph
+                    unsigned int uid = feather::plugin::add_node(324,name,s);
+                    std::stringstream shapename;
+                    shapename << name << "_shape";
+                    meshuid.push_back(uid);
+                    shapeuid.push_back(feather::plugin::add_node(320,shapename.str(),s));
+                    std::cout << "mesh uid:" << uid << std::endl;
+                    // for now I'm just going to connect the root to the node 
+                    feather::status p = feather::plugin::connect(0,202,uid,201);
+                    if(p.state==feather::FAILED)
+                        std::cout << p.msg << std::endl;
+                };
+
+                feather::FMesh* mesh(unsigned int index) {
+                    typedef field::Field<feather::FMesh>* sourcefield;
+                    sourcefield sf = static_cast<sourcefield>(feather::plugin::get_field_base(meshuid[index],324,1,0));
+                    if(!sf) {
+                        std::cout << "NULL SOURCE FIELD\n";
+                        return nullptr;
+                    }
+                    return &sf->value;
+                };
+
+                // all the nodes and connections are made before the graph is
+                // updated, updating for each object gets slow with large files
+                void connect() {
+                    for(unsigned int i=0; i < meshuid.size(); i++) {
+                        typedef field::Field<feather::FMesh>* sourcefield;
+                        sourcefield sf = static_cast<sourcefield>(feather::plugin::get_field_base(meshuid[i],324,1,0));
+                        if(sf)
+                            sf->update = true;
+
+                        // connect the mesh node to the shape node
+                        feather::status p = feather::plugin::connect(meshuid[i],202,shapeuid[i],201);
+                        p = feather::plugin::connect(meshuid[i],2,shapeuid[i],1);
+                    }
+
+                    feather::plugin::update();
+                };
+
+                std::vector<unsigned int> meshuid;
+                std::vector<unsigned int> shapeuid;
+        };
+
+        // import obj file
+        status import_obj(parameter::ParameterList params) {
+            feather::status s;
+            std::string filename;
+            std::vector<unsigned int> uids;
+            bool selection=false;
+            bool spirit=false;
+            int threads=0;
+            bool merge=false;
+            bool p=false;
+            p = params.getParameterValue<std::string>("filename",filename);
+            if(!p)
+                return status(FAILED,"filename parameter failed");
+            p = params.getParameterValue<bool>("selection",selection);
+            if(!p)
+                return status(FAILED,"selection parameter failed");
+            // optional, use the old spirit parser to check the fast reader against
+            params.getParameterValue<bool>("spirit",spirit);
+            // optional, number of threads to read with, 0 uses every core
+            params.getParameterValue<int>("threads",threads);
+            // optional, put every object into a single mesh
+            params.getParameterValue<bool>("merge",merge);
+
+            if(spirit)
+                return import_obj_spirit(filename);
+
+            obj_node_sink sink;
+
+            if(merge) {
+                // every object goes into one mesh named after the file
+                io::obj_format::mesh_data_t data;
+                s = io::obj_format::read(filename,data,std::max(threads,0));
+                if(s.state==FAILED)
+                    return s;
+
+                io::obj_format::object_size_t size = { static_cast<uint32_t>(data.v.size()), static_cast<uint32_t>(data.st.size()), static_cast<uint32_t>(data.vn.size()), data.face_count() };
+                sink.object(0,io::obj_format::default_name(filename),size);
+                feather::FMesh* mesh = sink.mesh(0);
+                if(mesh)
+                    io::obj_format::get_mesh(std::move(data),*mesh);
+            } else {
+                // the nodes are only made once the whole file has parsed, the
+                // meshes are then moved into the node's mesh field
+                s = io::obj_format::stream(filename,sink,std::max(threads,0));
+                if(s.state==FAILED)
+                    return s;
+            }
+
+            sink.connect();
+
+            return s;
+        };
+
+        // import any file assimp can read, fbx, gltf, dae, stl, ...
+        status import_file(parameter::ParameterList params) {
+            std::string filename;
+            bool triangulate=true;
+            bool join=true;
+            bool normals=true;
+            int threads=0;
+            bool p = params.getParameterValue<std::string>("filename",filename);
+            if(!p)
+                return status(FAILED,"filename parameter failed");
+            // optional, the post processing steps are all on by default
+            params.getParameterValue<bool>("triangulate",triangulate);
+            params.getParameterValue<bool>("join",join);
+            params.getParameterValue<bool>("normals",normals);
+            // optional, number of threads to process the meshes with, 0 uses every core
+            params.getParameterValue<int>("threads",threads);
+
+            unsigned int steps = 0;
+            if(triangulate)
+                steps |= io::assimp_format::Triangulate;
+            if(join)
+                steps |= io::assimp_format::JoinVertices;
+            if(normals)
+                steps |= io::assimp_format::Normals;
+
+            obj_node_sink sink;
+            status s = io::assimp_format::read(filename,sink,steps,std::max(threads,0));
+            if(s.state==FAILED)
+                return s;
+
+            sink.connect();
+
+            return s;
+        };
+
+        // time each import and export path on generated meshes, the scene is
+        // saved first and opened again when it finishes
+        status benchmark_io(parameter::ParameterList params) {
+            std::string path = "/tmp";
+            int max_faces = 1000000;
+            std::string report;
+            // all the parameters are optional
+            params.getParameterValue<std::string>("path",path);
+            params.getParameterValue<int>("max_faces",max_faces);
+            params.getParameterValue<std::string>("report",report);
+
+            std::vector<io::benchmark::result_t> results;
+            status s = io::benchmark::run(path,std::max(max_faces,0),results);
+            io::benchmark::print(results);
+
+            if(!report.empty() && !io::benchmark::write_report(report,results))
+                return status(FAILED,"failed to write benchmark report");
+
+            return s;
+        };
+
         // export camera data file
         status export_camera_data(parameter::ParameterList params) {
             std::cout << "running export_camera_data command" << std::endl;
@@ -224,14 +444,34 @@ namespace feather
                 return status(FAILED,"uid parameter failed");
 
             io::write_camera_data(path,uid); 
- 
+
             return status();
         };
 
         // export obj file
         status export_obj(parameter::ParameterList params) {
             std::cout << "running export_obj command" << std::endl;
-            return status();
+
+            std::string filename;
+            bool selection;
+            bool animation=false;
+            int sframe=0;
+            int eframe=0;
+
+            bool p = params.getParameterValue<std::string>("filename",filename);
+            if(!p)
+                return status(FAILED,"filename parameter failed");
+
+            p = params.getParameterValue<bool>("selection",selection);
+            if(!p)
+                return status(FAILED,"selection parameter failed");
+
+            // optional, the frame range is only needed for animation
+            params.getParameterValue<bool>("animation",animation);
+            params.getParameterValue<int>("sframe",sframe);
+            params.getParameterValue<int>("eframe",eframe);
+
+            return io::export_obj(filename,selection,animation,sframe,eframe);
         };
 
         // export obj file
@@ -269,9 +509,21 @@ namespace feather
             if(!p)
                 return status(FAILED,"eframe parameter failed");
 
+            // optional, write binary_little_endian instead of ascii
+            bool binary=false;
+            params.getParameterValue<bool>("binary",binary);
+
+            // optional, write shared vertices instead of one per face point
+            bool indexed=false;
+            params.getParameterValue<bool>("indexed",indexed);
+
+            // optional, number of threads writing animation frames, 0 uses every core
+            int threads=0;
+            params.getParameterValue<int>("threads",threads);
+
             //std::vector<unsigned int> uids = plugin::get_selected_nodes();
             //std::cout << "There are " << uids.size() << " nodes selected\n";
-            status pass = io::export_ply(path,selection,animation,sframe,eframe);
+            status pass = io::export_ply(path,selection,animation,sframe,eframe,binary,indexed,std::max(threads,0));
             /*
             for(auto uid : uids){
                 std::cout << "uid:" << uid << " type:" << plugin::get_node_id(uid,pass) << std::endl;
@@ -289,6 +541,99 @@ namespace feather
             return pass;
         };
 
+        // export point cache
+        status export_cache(parameter::ParameterList params) {
+            std::cout << "running export_cache command" << std::endl;
+
+            std::string filename;
+            bool selection;
+            int sframe;
+            int eframe;
+            bool normals=false;
+
+            bool p = params.getParameterValue<std::string>("filename",filename);
+            if(!p)
+                return status(FAILED,"filename parameter failed");
+
+            p = params.getParameterValue<bool>("selection",selection);
+            if(!p)
+                return status(FAILED,"selection parameter failed");
+
+            p = params.getParameterValue<int>("sframe",sframe);
+            if(!p)
+                return status(FAILED,"sframe parameter failed");
+
+            p = params.getParameterValue<int>("eframe",eframe);
+            if(!p)
+                return status(FAILED,"eframe parameter failed");
+
+            // optional, store the normals for each frame as well
+            params.getParameterValue<bool>("normals",normals);
+
+            return io::export_cache(filename,selection,sframe,eframe,normals);
+        };
+
+        // export camera tracks file
+        status export_camera_tracks(parameter::ParameterList params) {
+            std::cout << "running export_camera_tracks command" << std::endl;
+
+            std::string filename;
+            bool selection;
+            int sframe;
+            int eframe;
+
+            bool p = params.getParameterValue<std::string>("filename",filename);
+            if(!p)
+                return status(FAILED,"filename parameter failed");
+
+            p = params.getParameterValue<bool>("selection",selection);
+            if(!p)
+                return status(FAILED,"selection parameter failed");
+
+            p = params.getParameterValue<int>("sframe",sframe);
+            if(!p)
+                return status(FAILED,"sframe parameter failed");
+
+            p = params.getParameterValue<int>("eframe",eframe);
+            if(!p)
+                return status(FAILED,"eframe parameter failed");
+
+            // the selected cameras or every camera in the scene
+            std::vector<unsigned int> uids;
+            if(selection) {
+                for(auto uid : plugin::get_selected_nodes())
+                    if(scenegraph::get_node_type(uid) == node::Camera)
+                        uids.push_back(uid);
+            } else {
+                std::vector<uint32_t> cameras;
+                scenegraph::get_node_by_type(node::Camera,cameras);
+                uids.assign(cameras.begin(),cameras.end());
+            }
+
+            if(uids.empty())
+                return status(FAILED,"no cameras to export");
+
+            return io::export_camera_tracks(filename,uids,sframe,eframe);
+        };
+
+        // import point cache
+        status import_cache(parameter::ParameterList params) {
+            std::cout << "running import_cache command" << std::endl;
+
+            std::string filename;
+            int frame;
+
+            bool p = params.getParameterValue<std::string>("filename",filename);
+            if(!p)
+                return status(FAILED,"filename parameter failed");
+
+            p = params.getParameterValue<int>("frame",frame);
+            if(!p)
+                return status(FAILED,"frame parameter failed");
+
+            return io::import_cache(filename,frame);
+        };
+
     } // namespace command
 
 } // namespace feather
@@ -298,11 +643,25 @@ ADD_COMMAND("open_feather",OPEN_FEATHER,open_feather)
 
 ADD_PARAMETER(command::OPEN_FEATHER,1,parameter::String,"filename")
 
+ADD_PARAMETER(command::OPEN_FEATHER,2,parameter::Bool,"lazy")
+
 // Save Feather Command
 ADD_COMMAND("save_feather",SAVE_FEATHER,save_feather)
 
 ADD_PARAMETER(command::SAVE_FEATHER,1,parameter::String,"filename")
 
+ADD_PARAMETER(command::SAVE_FEATHER,2,parameter::Bool,"compress")
+
+ADD_PARAMETER(command::SAVE_FEATHER,3,parameter::Bool,"shuffle")
+
+ADD_PARAMETER(command::SAVE_FEATHER,4,parameter::Bool,"delta")
+
+ADD_PARAMETER(command::SAVE_FEATHER,5,parameter::Int,"threads")
+
+ADD_PARAMETER(command::SAVE_FEATHER,6,parameter::Bool,"incremental")
+
+ADD_PARAMETER(command::SAVE_FEATHER,7,parameter::Bool,"background")
+
 // Import Obj Command
 ADD_COMMAND("import_obj",IMPORT_OBJ,import_obj)
 
@@ -310,6 +669,12 @@ ADD_PARAMETER(command::IMPORT_OBJ,1,parameter::String,"filename")
 
 ADD_PARAMETER(command::IMPORT_OBJ,2,parameter::Bool,"selection")
 
+ADD_PARAMETER(command::IMPORT_OBJ,3,parameter::Bool,"spirit")
+
+ADD_PARAMETER(command::IMPORT_OBJ,4,parameter::Int,"threads")
+
+ADD_PARAMETER(command::IMPORT_OBJ,5,parameter::Bool,"merge")
+
 // Export Camera Data Command
 ADD_COMMAND("export_camera_data",EXPORT_CAMERA_DATA,export_camera_data)
 
@@ -320,6 +685,16 @@ ADD_PARAMETER(command::EXPORT_CAMERA_DATA,2,parameter::Int,"uid")
 // Export Obj Command
 ADD_COMMAND("export_obj",EXPORT_OBJ,export_obj)
 
+ADD_PARAMETER(command::EXPORT_OBJ,1,parameter::String,"filename")
+
+ADD_PARAMETER(command::EXPORT_OBJ,2,parameter::Bool,"selection")
+
+ADD_PARAMETER(command::EXPORT_OBJ,3,parameter::Bool,"animation")
+
+ADD_PARAMETER(command::EXPORT_OBJ,4,parameter::Int,"sframe")
+
+ADD_PARAMETER(command::EXPORT_OBJ,5,parameter::Int,"eframe")
+
 // Export Ply Command
 ADD_COMMAND("export_ply",EXPORT_PLY,export_ply)
 
@@ -333,5 +708,74 @@ ADD_PARAMETER(command::EXPORT_PLY,4,parameter::Int,"sframe")
 
 ADD_PARAMETER(command::EXPORT_PLY,5,parameter::Int,"eframe")
 
-INIT_COMMAND_CALLS(EXPORT_PLY)
+ADD_PARAMETER(command::EXPORT_PLY,6,parameter::Bool,"binary")
+
+ADD_PARAMETER(command::EXPORT_PLY,7,parameter::Bool,"indexed")
+
+ADD_PARAMETER(command::EXPORT_PLY,8,parameter::Int,"threads")
+
+// Export Cache Command
+ADD_COMMAND("export_cache",EXPORT_CACHE,export_cache)
+
+ADD_PARAMETER(command::EXPORT_CACHE,1,parameter::String,"filename")
+
+ADD_PARAMETER(command::EXPORT_CACHE,2,parameter::Bool,"selection")
+
+ADD_PARAMETER(command::EXPORT_CACHE,3,parameter::Int,"sframe")
+
+ADD_PARAMETER(command::EXPORT_CACHE,4,parameter::Int,"eframe")
+
+ADD_PARAMETER(command::EXPORT_CACHE,5,parameter::Bool,"normals")
+
+// Import Cache Command
+ADD_COMMAND("import_cache",IMPORT_CACHE,import_cache)
+
+ADD_PARAMETER(command::IMPORT_CACHE,1,parameter::String,"filename")
+
+ADD_PARAMETER(command::IMPORT_CACHE,2,parameter::Int,"frame")
+
+// Load Geometry Command
+ADD_COMMAND("load_geometry",LOAD_GEOMETRY,load_geometry)
+
+ADD_PARAMETER(command::LOAD_GEOMETRY,1,parameter::Bool,"selection")
+
+// Compact Feather Command
+ADD_COMMAND("compact_feather",COMPACT_FEATHER,compact_feather)
+
+ADD_PARAMETER(command::COMPACT_FEATHER,1,parameter::String,"filename")
+
+// Export Camera Tracks Command
+ADD_COMMAND("export_camera_tracks",EXPORT_CAMERA_TRACKS,export_camera_tracks)
+
+ADD_PARAMETER(command::EXPORT_CAMERA_TRACKS,1,parameter::String,"filename")
+
+ADD_PARAMETER(command::EXPORT_CAMERA_TRACKS,2,parameter::Bool,"selection")
+
+ADD_PARAMETER(command::EXPORT_CAMERA_TRACKS,3,parameter::Int,"sframe")
+
+ADD_PARAMETER(command::EXPORT_CAMERA_TRACKS,4,parameter::Int,"eframe")
+
+// Import File Command
+ADD_COMMAND("import_file",IMPORT_FILE,import_file)
+
+ADD_PARAMETER(command::IMPORT_FILE,1,parameter::String,"filename")
+
+ADD_PARAMETER(command::IMPORT_FILE,2,parameter::Bool,"triangulate")
+
+ADD_PARAMETER(command::IMPORT_FILE,3,parameter::Bool,"join")
+
+ADD_PARAMETER(command::IMPORT_FILE,4,parameter::Bool,"normals")
+
+ADD_PARAMETER(command::IMPORT_FILE,5,parameter::Int,"threads")
+
+// Benchmark IO Command
+ADD_COMMAND("benchmark_io",BENCHMARK_IO,benchmark_io)
+
+ADD_PARAMETER(command::BENCHMARK_IO,1,parameter::String,"path")
+
+ADD_PARAMETER(command::BENCHMARK_IO,2,parameter::Int,"max_faces")
+
+ADD_PARAMETER(command::BENCHMARK_IO,3,parameter::String,"report")
+
+INIT_COMMAND_CALLS(BENCHMARK_IO)
 
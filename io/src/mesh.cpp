@@ -0,0 +1,302 @@
+/***********************************************************************
+ *
+ * Filename: mesh.cpp
+ *
+ * Description: Binary mesh files for caching single assets.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#include "mesh.hpp"
+
+using namespace feather;
+using namespace io::mesh_format;
+
+namespace
+{
+
+    const char magic[4] = { 'F', 'M', 'S', '\0' };
+
+    static_assert(sizeof(header_t) == 16, "header_t has to match the file");
+    static_assert(sizeof(array_t) == 24, "array_t has to match the file");
+    static_assert(sizeof(group_t) == 16, "group_t has to match the file");
+
+    // bytes in each item of an array, 0 for types this version doesn't know
+    size_t item_size(uint32_t type)
+    {
+        switch(type) {
+            case Name: return 1;
+            case Vertices: return sizeof(FVertex3D);
+            case TextureCoords: return sizeof(FTextureCoord);
+            case Normals: return sizeof(FVertex3D);
+            case FaceSizes: return sizeof(uint32_t);
+            case FacePoints: return sizeof(FFacePoint);
+            case Groups: return sizeof(group_t);
+            case Materials: return 1;
+            default: return 0;
+        }
+    }
+
+    // writes count 32 bit values with a single write, structs of floats
+    // can be passed as float arrays
+    template <typename T>
+    void put_array(std::ostream& file, const T* values, size_t count)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        io::write_buffer buffer;
+        buffer.put_binary(values, count);
+        file.write(buffer.data(), buffer.size());
+#else
+        file.write(reinterpret_cast<const char*>(values), count*sizeof(T));
+#endif
+    }
+
+} // namespace
+
+
+status io::mesh_format::write(std::string filename, std::string name, const FVertex3DArray& v, const FTextureCoordArray& st, const FVertex3DArray& vn, const std::vector<group_info_t>& groups)
+{
+    // the faces and groups are the only arrays that have to be gathered
+    uint64_t faces = 0;
+    uint64_t facepoints = 0;
+    std::string materials;
+    std::vector<group_t> group(groups.size());
+
+    for(unsigned int i=0; i < groups.size(); i++) {
+        const group_info_t& g = groups[i];
+        group[i].material = materials.size();
+        group[i].s = g.s;
+        group[i].faces = g.faces;
+        group[i].pad = 0;
+        materials.append(g.material);
+        materials.push_back('\0');
+
+        faces += g.faces;
+        for(size_t j=0; j < g.faces; j++)
+            facepoints += g.f[j].size();
+    }
+
+    write_buffer facebuffer;
+    facebuffer.reserve(faces*sizeof(uint32_t) + facepoints*sizeof(FFacePoint));
+    for(auto& g : groups)
+        for(size_t j=0; j < g.faces; j++)
+            facebuffer.put_binary<uint32_t>(g.f[j].size());
+    for(auto& g : groups)
+        for(size_t j=0; j < g.faces; j++)
+            facebuffer.put_binary(reinterpret_cast<const uint32_t*>(g.f[j].data()), g.f[j].size()*3);
+
+    std::vector<array_t> table = {
+        { Name, 0, name.size(), 0 },
+        { Vertices, 0, v.size(), 0 },
+        { TextureCoords, 0, st.size(), 0 },
+        { Normals, 0, vn.size(), 0 },
+        { FaceSizes, 0, faces, 0 },
+        { FacePoints, 0, facepoints, 0 },
+        { Groups, 0, group.size(), 0 },
+        { Materials, 0, materials.size(), 0 }
+    };
+
+    uint64_t offset = padded(sizeof(header_t) + table.size()*sizeof(array_t), 16);
+    for(auto& a : table) {
+        a.offset = offset;
+        offset = padded(offset + a.count*item_size(a.type), 16);
+    }
+
+    std::fstream file;
+    file.open(filename.c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
+    if(!file.is_open()) {
+        std::cout << "error opening \"" << filename << "\" mesh file\n";
+        return status(FAILED,"could not open mesh file");
+    }
+
+    write_buffer buffer;
+    buffer.append(magic, 4);
+    buffer.put_binary(version);
+    buffer.put_binary<uint32_t>(table.size());
+    buffer.put_binary<uint32_t>(0);
+    for(auto& a : table) {
+        buffer.put_binary(a.type);
+        buffer.put_binary(a.pad);
+        buffer.put_binary(a.count);
+        buffer.put_binary(a.offset);
+    }
+    file.write(buffer.data(), buffer.size());
+
+    // each array is written in one go after padding up to it's offset
+    const char zeros[16] = {};
+    uint64_t p = buffer.size();
+    auto pad = [&](const array_t& a) {
+        file.write(zeros, a.offset - p);
+        p = a.offset + a.count*item_size(a.type);
+    };
+
+    pad(table[0]);
+    file.write(name.data(), name.size());
+    pad(table[1]);
+    put_array(file, reinterpret_cast<const float*>(v.data()), v.size()*3);
+    pad(table[2]);
+    put_array(file, reinterpret_cast<const float*>(st.data()), st.size()*2);
+    pad(table[3]);
+    put_array(file, reinterpret_cast<const float*>(vn.data()), vn.size()*3);
+    pad(table[4]);
+    file.write(facebuffer.data(), faces*sizeof(uint32_t));
+    pad(table[5]);
+    file.write(facebuffer.data() + faces*sizeof(uint32_t), facepoints*sizeof(FFacePoint));
+    pad(table[6]);
+    put_array(file, reinterpret_cast<const uint32_t*>(group.data()), group.size()*4);
+    pad(table[7]);
+    file.write(materials.data(), materials.size());
+
+    bool failed = file.fail();
+    file.close();
+
+    if(failed)
+        return status(FAILED,"failed to write mesh file");
+
+    return status();
+}
+
+status io::mesh_format::write(std::string filename, std::string name, const FMesh& mesh)
+{
+    std::vector<group_info_t> groups;
+    if(!mesh.f.empty())
+        groups.push_back({ std::string(), 0, mesh.f.data(), mesh.f.size() });
+    return write(filename, name, mesh.v, mesh.st, mesh.vn, groups);
+}
+
+
+status io::mesh_format::reader::open(std::string filename)
+{
+    _header = header_t();
+    _name.clear();
+    for(auto& a : _array)
+        a = array_data_t{ nullptr, 0 };
+
+    if(!_file.open(filename)) {
+        std::cout << "error loading \"" << filename << "\" mesh file\n";
+        return status(FAILED,"loading error");
+    }
+
+    const char* begin = _file.begin();
+    uint64_t size = _file.size();
+
+    if(size < sizeof(header_t) || memcmp(begin, magic, 4))
+        return status(FAILED,"not a mesh file");
+
+    _header.version = get_binary<uint32_t>(begin+4);
+    _header.arrays = get_binary<uint32_t>(begin+8);
+
+    if(_header.version != version)
+        return status(FAILED,"unknown mesh version");
+
+    if((size - sizeof(header_t)) / sizeof(array_t) < _header.arrays)
+        return status(FAILED,"mesh array table is truncated");
+
+    for(uint32_t i=0; i < _header.arrays; i++) {
+        const char* p = begin + sizeof(header_t) + i*sizeof(array_t);
+        uint32_t type = get_binary<uint32_t>(p);
+        uint64_t count = get_binary<uint64_t>(p+8);
+        uint64_t offset = get_binary<uint64_t>(p+16);
+
+        size_t bytes = item_size(type);
+        if(!bytes)
+            continue;
+
+        if(offset > size || (size - offset) / bytes < count)
+            return status(FAILED,"mesh array is truncated");
+
+        _array[type] = array_data_t{ begin + offset, count };
+    }
+
+    // every face has to fit in the face points and the groups have to
+    // cover every face
+    uint64_t facepoints = 0;
+    for(uint64_t i=0; i < count(FaceSizes); i++)
+        facepoints += get_binary<uint32_t>(_array[FaceSizes].data + i*4);
+    if(facepoints != count(FacePoints))
+        return status(FAILED,"mesh face data doesn't match it's face points");
+
+    uint64_t faces = 0;
+    for(uint64_t i=0; i < count(Groups); i++) {
+        const char* g = _array[Groups].data + i*sizeof(group_t);
+        if(get_binary<uint32_t>(g) >= count(Materials))
+            return status(FAILED,"mesh group material is out of range");
+        faces += get_binary<uint32_t>(g+8);
+    }
+    if(count(Groups) && faces != count(FaceSizes))
+        return status(FAILED,"mesh groups don't match it's faces");
+
+    // the materials are read as c strings so the last has to be terminated
+    if(count(Materials) && _array[Materials].data[count(Materials)-1] != '\0')
+        return status(FAILED,"mesh materials aren't terminated");
+
+    _name.assign(_array[Name].data ? _array[Name].data : "", count(Name));
+
+    return status();
+}
+
+group_info_t io::mesh_format::reader::group(unsigned int index) const
+{
+    const char* g = _array[Groups].data + uint64_t(index)*sizeof(group_t);
+    group_info_t info;
+    info.material = _array[Materials].data + get_binary<uint32_t>(g);
+    info.s = get_binary<int32_t>(g+4);
+    info.f = nullptr;
+    info.faces = get_binary<uint32_t>(g+8);
+    return info;
+}
+
+void io::mesh_format::reader::get_mesh(FMesh& mesh) const
+{
+    get_vertices(mesh.v);
+    get_texture_coords(mesh.st);
+    get_normals(mesh.vn);
+    get_faces(mesh.f);
+}
+
+void io::mesh_format::reader::get_vertices(FVertex3DArray& v) const
+{
+    v.resize(count(Vertices));
+    if(!v.empty())
+        get_binary(_array[Vertices].data, reinterpret_cast<float*>(v.data()), v.size()*3);
+}
+
+void io::mesh_format::reader::get_texture_coords(FTextureCoordArray& st) const
+{
+    st.resize(count(TextureCoords));
+    if(!st.empty())
+        get_binary(_array[TextureCoords].data, reinterpret_cast<float*>(st.data()), st.size()*2);
+}
+
+void io::mesh_format::reader::get_normals(FVertex3DArray& vn) const
+{
+    vn.resize(count(Normals));
+    if(!vn.empty())
+        get_binary(_array[Normals].data, reinterpret_cast<float*>(vn.data()), vn.size()*3);
+}
+
+void io::mesh_format::reader::get_faces(std::vector<FFace>& f) const
+{
+    f.resize(count(FaceSizes));
+    const char* fp = _array[FacePoints].data;
+    for(size_t i=0; i < f.size(); i++) {
+        FFace& face = f[i];
+        face.resize(get_binary<uint32_t>(_array[FaceSizes].data + i*4));
+        get_binary(fp, reinterpret_cast<uint32_t*>(face.data()), face.size()*3);
+        fp += face.size()*sizeof(FFacePoint);
+    }
+}
@@ -0,0 +1,145 @@
+/***********************************************************************
+ *
+ * Filename: mesh.hpp
+ *
+ * Description: Binary mesh files for caching single assets.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <feather/types.hpp>
+#include <feather/deps.hpp>
+#include <feather/status.hpp>
+#include "mmap.hpp"
+#include "buffer.hpp"
+
+namespace io
+{
+
+/*
+ * MESH FORMAT
+ *
+ * [header_t]
+ * [array_t]            // one for each array, header_t.arrays
+ * ARRAYS               // each starts on a 16 byte boundary
+ *      Name            [char]
+ *      Vertices        [FVertex3D]
+ *      TextureCoords   [FTextureCoord]
+ *      Normals         [FVertex3D]
+ *      FaceSizes       [uint32]        // face points in each face
+ *      FacePoints      [FFacePoint]
+ *      Groups          [group_t]       // the faces in order of the groups
+ *      Materials       [char]          // every group's material with a '\0' after each
+ *
+ * The array table gives the type, count and offset of every array so a
+ * reader can find any array without walking the others, and arrays it
+ * doesn't know about are skipped. Everything is little endian.
+ */
+    namespace mesh_format
+    {
+
+        const uint32_t version = 1;
+
+        enum ArrayType {
+            Name=1,
+            Vertices=2,
+            TextureCoords=3,
+            Normals=4,
+            FaceSizes=5,
+            FacePoints=6,
+            Groups=7,
+            Materials=8
+        };
+
+        struct header_t {
+            char magic[4];          // "FMS\0"
+            uint32_t version;
+            uint32_t arrays;
+            uint32_t pad;
+        };
+
+        struct array_t {
+            uint32_t type;
+            uint32_t pad;
+            uint64_t count;         // items, not bytes
+            uint64_t offset;
+        };
+
+        struct group_t {
+            uint32_t material;      // offset into the materials array
+            int32_t s;              // smoothing group
+            uint32_t faces;
+            uint32_t pad;
+        };
+
+        // a run of faces with the same material and smoothing group
+        struct group_info_t {
+            std::string material;
+            int s;
+            const feather::FFace* f;
+            size_t faces;
+        };
+
+        // writes the arrays straight from the vectors, only the faces are
+        // gathered into a buffer first
+        feather::status write(std::string filename, std::string name, const feather::FVertex3DArray& v, const feather::FTextureCoordArray& st, const feather::FVertex3DArray& vn, const std::vector<group_info_t>& groups);
+        feather::status write(std::string filename, std::string name, const feather::FMesh& mesh);
+
+        // Maps the file and finds the arrays from the table, get_mesh()
+        // copies them out into a mesh.
+        class reader
+        {
+            public:
+                feather::status open(std::string filename);
+
+                const std::string& name() const { return _name; };
+                size_t vertex_count() const { return count(Vertices); };
+                size_t face_count() const { return count(FaceSizes); };
+                size_t group_count() const { return count(Groups); };
+
+                // material, smoothing group and number of faces, f is left null
+                group_info_t group(unsigned int index) const;
+
+                // each array is copied with a single memcpy, faces with one for each face
+                void get_mesh(feather::FMesh& mesh) const;
+                void get_vertices(feather::FVertex3DArray& v) const;
+                void get_texture_coords(feather::FTextureCoordArray& st) const;
+                void get_normals(feather::FVertex3DArray& vn) const;
+                void get_faces(std::vector<feather::FFace>& f) const;
+
+            private:
+                struct array_data_t {
+                    const char* data;
+                    uint64_t count;
+                };
+
+                size_t count(ArrayType type) const { return _array[type].count; };
+
+                mapped_file _file;
+                header_t _header = header_t();
+                std::string _name;
+                array_data_t _array[Materials+1];
+        };
+
+    } // namespace mesh_format
+
+} // namespace io
+
+#endif
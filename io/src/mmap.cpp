@@ -0,0 +1,87 @@
+/***********************************************************************
+ *
+ * Filename: mmap.cpp
+ *
+ * Description: Read only memory mapped files.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#include "mmap.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+io::mapped_file::mapped_file()
+    : _fd(-1),
+    _data(nullptr),
+    _size(0)
+{
+}
+
+io::mapped_file::~mapped_file()
+{
+    close();
+}
+
+bool io::mapped_file::open(std::string filename)
+{
+    close();
+
+    _fd = ::open(filename.c_str(), O_RDONLY);
+    if(_fd == -1)
+        return false;
+
+    struct stat sb;
+    if(fstat(_fd, &sb) == -1) {
+        close();
+        return false;
+    }
+
+    _size = sb.st_size;
+
+    // mmap will not map an empty file but it's still a valid file
+    if(!_size)
+        return true;
+
+    void* addr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if(addr == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    // the parsers walk the file front to back
+    madvise(addr, _size, MADV_SEQUENTIAL);
+
+    _data = static_cast<const char*>(addr);
+    return true;
+}
+
+void io::mapped_file::close()
+{
+    if(_data)
+        munmap(const_cast<char*>(_data), _size);
+
+    if(_fd != -1)
+        ::close(_fd);
+
+    _fd = -1;
+    _data = nullptr;
+    _size = 0;
+}
@@ -0,0 +1,62 @@
+/***********************************************************************
+ *
+ * Filename: mmap.hpp
+ *
+ * Description: Read only memory mapped files.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#ifndef MMAP_HPP
+#define MMAP_HPP
+
+#include <string>
+#include <cstddef>
+
+namespace io
+{
+
+    // Maps a whole file into memory so the parsers can walk it in place
+    // without first copying it into a buffer. The mapping is released when
+    // the object goes out of scope.
+    class mapped_file
+    {
+        public:
+            mapped_file();
+            ~mapped_file();
+
+            bool open(std::string filename);
+            void close();
+
+            bool is_open() const { return _fd != -1; };
+            const char* data() const { return _data; };
+            const char* begin() const { return _data; };
+            const char* end() const { return _data + _size; };
+            size_t size() const { return _size; };
+
+        private:
+            mapped_file(const mapped_file&) = delete;
+            mapped_file& operator=(const mapped_file&) = delete;
+
+            int _fd;
+            const char* _data;
+            size_t _size;
+    };
+
+} // namespace io
+
+#endif
@@ -0,0 +1,1199 @@
+/***********************************************************************
+ *
+ * Filename: obj.cpp
+ *
+ * Description: Fast reader for obj files.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#include "obj.hpp"
+#include "mmap.hpp"
+#include "parallel.hpp"
+
+#include <unordered_map>
+
+using namespace feather;
+
+namespace
+{
+
+    // TOKENIZER
+    // None of these functions allocate, they only move the pointer along
+    // the mapped file. The mapped file is not null terminated so every
+    // read is checked against end.
+
+    inline bool is_blank(char c) { return c==' ' || c=='\t' || c=='\r'; }
+
+    inline bool is_digit(char c) { return c>='0' && c<='9'; }
+
+    inline bool is_eol(const char* p, const char* end) { return p==end || *p=='\n' || *p=='#'; }
+
+    inline const char* skip_blank(const char* p, const char* end)
+    {
+        while(p < end && is_blank(*p))
+            ++p;
+        return p;
+    }
+
+    inline const char* skip_line(const char* p, const char* end)
+    {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end-p));
+        return eol ? eol+1 : end;
+    }
+
+    // a token has to end on a blank or the end of the line
+    inline bool is_token_end(const char* p, const char* end) { return p==end || is_blank(*p) || *p=='\n'; }
+
+    const double powers_of_10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    // Parses a decimal float. The first 19 significant digits are
+    // accumulated in an integer and scaled once at the end which is more
+    // than enough precision for a 32bit float.
+    bool parse_float(const char*& p, const char* end, float& value)
+    {
+        const char* s = p;
+        bool neg = false;
+
+        if(s < end && (*s=='-' || *s=='+')) {
+            neg = (*s=='-');
+            ++s;
+        }
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool any = false;
+
+        while(s < end && is_digit(*s)) {
+            if(digits < 19) {
+                mantissa = mantissa*10 + (*s-'0');
+                if(mantissa)
+                    ++digits;
+            } else
+                ++exponent;
+            any = true;
+            ++s;
+        }
+
+        if(s < end && *s=='.') {
+            ++s;
+            while(s < end && is_digit(*s)) {
+                if(digits < 19) {
+                    mantissa = mantissa*10 + (*s-'0');
+                    if(mantissa)
+                        ++digits;
+                    --exponent;
+                }
+                any = true;
+                ++s;
+            }
+        }
+
+        if(!any)
+            return false;
+
+        if(s < end && (*s=='e' || *s=='E')) {
+            ++s;
+            bool eneg = false;
+            if(s < end && (*s=='-' || *s=='+')) {
+                eneg = (*s=='-');
+                ++s;
+            }
+            if(s==end || !is_digit(*s))
+                return false;
+            int e = 0;
+            while(s < end && is_digit(*s)) {
+                if(e < 10000)
+                    e = e*10 + (*s-'0');
+                ++s;
+            }
+            exponent += eneg ? -e : e;
+        }
+
+        double d = static_cast<double>(mantissa);
+
+        if(mantissa) {
+            // anything past this is 0 or inf for a float
+            if(exponent < -400)
+                exponent = -400;
+            if(exponent > 400)
+                exponent = 400;
+
+            while(exponent > 22) {
+                d *= powers_of_10[22];
+                exponent -= 22;
+            }
+            while(exponent < -22) {
+                d /= powers_of_10[22];
+                exponent += 22;
+            }
+            if(exponent > 0)
+                d *= powers_of_10[exponent];
+            else if(exponent < 0)
+                d /= powers_of_10[-exponent];
+        }
+
+        value = static_cast<float>(neg ? -d : d);
+        p = s;
+        return true;
+    }
+
+    bool parse_uint(const char*& p, const char* end, uint32_t& value)
+    {
+        const char* s = p;
+        uint64_t v = 0;
+
+        if(s==end || !is_digit(*s))
+            return false;
+
+        while(s < end && is_digit(*s)) {
+            v = v*10 + (*s-'0');
+            if(v > 0xffffffff)
+                return false;
+            ++s;
+        }
+
+        value = static_cast<uint32_t>(v);
+        p = s;
+        return true;
+    }
+
+    bool parse_int(const char*& p, const char* end, int& value)
+    {
+        const char* s = p;
+        bool neg = false;
+        uint32_t v = 0;
+
+        if(s < end && (*s=='-' || *s=='+')) {
+            neg = (*s=='-');
+            ++s;
+        }
+
+        if(!parse_uint(s, end, v) || v > 0x7fffffff)
+            return false;
+
+        value = neg ? -static_cast<int>(v) : static_cast<int>(v);
+        p = s;
+        return true;
+    }
+
+    // reads the rest of the line as a name, trailing blanks are removed
+    const char* parse_name(const char* p, const char* end, std::string& name)
+    {
+        const char* s = skip_blank(p, end);
+        const char* e = s;
+        const char* last = s;
+
+        while(e < end && *e!='\n') {
+            if(!is_blank(*e))
+                last = e+1;
+            ++e;
+        }
+
+        name.assign(s, last-s);
+        return e;
+    }
+
+    // reads the remaining floats on a line, only the first n are kept
+    bool parse_floats(const char*& p, const char* end, float* values, int n, int required)
+    {
+        int count = 0;
+        float ignored;
+
+        p = skip_blank(p, end);
+        while(!is_eol(p, end)) {
+            if(!parse_float(p, end, count < n ? values[count] : ignored) || !is_token_end(p, end))
+                return false;
+            ++count;
+            p = skip_blank(p, end);
+        }
+
+        for(int i=count; i < n; i++)
+            values[i] = 0;
+
+        return count >= required;
+    }
+
+    // Obj indices start at 1, negative indices count back from the last
+    // element read so far. count is the number of elements before this line.
+    bool parse_index(const char*& p, const char* end, uint32_t count, uint32_t& index)
+    {
+        int i;
+
+        if(!parse_int(p, end, i) || !i)
+            return false;
+
+        if(i > 0) {
+            index = i-1;
+            return true;
+        }
+
+        if(static_cast<uint32_t>(-i) > count)
+            return false;
+
+        index = count + i;
+        return true;
+    }
+
+    // v, v/vt, v//vn or v/vt/vn, missing indices are set to none
+    bool parse_facepoint(const char*& p, const char* end, const uint32_t* count, FFacePoint& fp)
+    {
+        fp.v = fp.vt = fp.vn = io::obj_format::none;
+
+        if(!parse_index(p, end, count[0], fp.v))
+            return false;
+
+        if(p < end && *p=='/') {
+            ++p;
+            if(p < end && *p!='/') {
+                if(!parse_index(p, end, count[1], fp.vt))
+                    return false;
+            }
+            if(p < end && *p=='/') {
+                ++p;
+                if(!parse_index(p, end, count[2], fp.vn))
+                    return false;
+            }
+        }
+
+        return is_token_end(p, end);
+    }
+
+    enum keyword_t { kV, kVT, kVN, kF, kL, kP, kO, kG, kUSEMTL, kMTLLIB, kS, kIgnored, kUnknown };
+
+    // valid statements that don't have anything to do with polygon meshes
+    const char* ignored_keywords[] = {
+        "vp", "mg", "lod", "bevel", "c_interp", "d_interp", "shadow_obj", "trace_obj",
+        "maplib", "usemap", "cstype", "deg", "bmat", "step", "curv", "curv2", "surf",
+        "parm", "trim", "hole", "scrv", "sp", "end", "con", "call", "csh", nullptr
+    };
+
+    inline keyword_t keyword(const char* k, size_t len)
+    {
+        if(len==1) {
+            switch(k[0]) {
+                case 'v': return kV;
+                case 'f': return kF;
+                case 'l': return kL;
+                case 'p': return kP;
+                case 'o': return kO;
+                case 'g': return kG;
+                case 's': return kS;
+            }
+        }
+        else if(len==2 && k[0]=='v') {
+            if(k[1]=='t')
+                return kVT;
+            if(k[1]=='n')
+                return kVN;
+        }
+        else if(len==6) {
+            if(!strncmp(k, "usemtl", 6))
+                return kUSEMTL;
+            if(!strncmp(k, "mtllib", 6))
+                return kMTLLIB;
+        }
+
+        for(int i=0; ignored_keywords[i]; i++) {
+            if(len==strlen(ignored_keywords[i]) && !strncmp(k, ignored_keywords[i], len))
+                return kIgnored;
+        }
+
+        return kUnknown;
+    }
+
+    // element counts for a run of lines
+    struct counts_t {
+        counts_t() : v(0), st(0), vn(0), f(0), fp(0), l(0), lv(0), p(0), o(0), grp(0), sg(0), mtllib(0) { };
+
+        counts_t& operator+=(const counts_t& c) {
+            v += c.v;
+            st += c.st;
+            vn += c.vn;
+            f += c.f;
+            fp += c.fp;
+            l += c.l;
+            lv += c.lv;
+            p += c.p;
+            o += c.o;
+            grp += c.grp;
+            sg += c.sg;
+            mtllib += c.mtllib;
+            return *this;
+        };
+
+        uint32_t v, st, vn, f, fp, l, lv, p, o, grp, sg, mtllib;
+    };
+
+    // where an object starts in a chunk, recorded by the scan
+    struct object_mark_t {
+        counts_t at;        // elements in the chunk before the object
+        const char* name;   // text after the 'o'
+    };
+
+    // A chunk is a run of whole lines from the file. When the file is
+    // split the chunks are counted first and the prefix sum of the counts
+    // tells each chunk where it's data goes, this also turns the file's
+    // global indices into array indices without a fix up pass over the
+    // faces afterwards.
+    struct chunk_t {
+        chunk_t() : begin(nullptr), end(nullptr), error(nullptr), maxv(0), maxvt(0), maxvn(0) { };
+
+        const char* begin;
+        const char* end;
+        counts_t count;     // elements in this chunk
+        counts_t offset;    // elements in every chunk before this one
+        std::vector<object_mark_t> objects;
+        const char* error;  // first line that failed to parse
+        std::string g;      // last group name given before the chunk's first object
+        uint32_t maxv;      // largest face indices used
+        uint32_t maxvt;
+        uint32_t maxvn;
+    };
+
+    // don't bother splitting anything smaller than this
+    const size_t min_chunk_size = 4 << 20;
+
+    // Splits the file into chunks of whole lines, a few more chunks than
+    // threads are used so one slow chunk doesn't hold up the rest.
+    void split(const io::mapped_file& file, unsigned int threads, std::vector<chunk_t>& chunk)
+    {
+        size_t chunks = std::max<size_t>(1, std::min<size_t>(threads*4, file.size()/min_chunk_size));
+        if(threads==1)
+            chunks = 1;
+
+        chunk.resize(chunks);
+        const char* p = file.begin();
+
+        for(size_t i=0; i < chunks; i++) {
+            chunk[i].begin = p;
+            if(i+1 < chunks) {
+                p = std::max(p, file.begin() + file.size()*(i+1)/chunks);
+                p = skip_line(p, file.end());
+            } else
+                p = file.end();
+            chunk[i].end = p;
+        }
+    }
+
+    // Only counts the elements in the chunk and notes where objects start,
+    // nothing else is parsed.
+    void scan_chunk(chunk_t& chunk)
+    {
+        const char* p = chunk.begin;
+        const char* end = chunk.end;
+        counts_t& n = chunk.count;
+
+        while(p < end)
+        {
+            p = skip_blank(p, end);
+
+            if(p==end)
+                break;
+
+            if(*p=='\n' || *p=='#') {
+                p = skip_line(p, end);
+                continue;
+            }
+
+            const char* k = p;
+            while(!is_token_end(p, end))
+                ++p;
+
+            uint32_t* tokens = nullptr;
+
+            switch(keyword(k, p-k)) {
+                case kV: ++n.v; break;
+                case kVT: ++n.st; break;
+                case kVN: ++n.vn; break;
+                case kF: ++n.f; tokens = &n.fp; break;
+                case kL: ++n.l; tokens = &n.lv; break;
+                case kP: tokens = &n.p; break;
+                case kO: {
+                    object_mark_t mark;
+                    mark.at = n;
+                    mark.name = p;
+                    chunk.objects.push_back(mark);
+                    ++n.o;
+                    break;
+                }
+                case kG:
+                    if(!n.o)
+                        parse_name(p, end, chunk.g);
+                    break;
+                case kUSEMTL: ++n.grp; break;
+                case kMTLLIB: ++n.mtllib; break;
+                case kS: ++n.sg; break;
+                default: break;
+            }
+
+            // count the indices on the line
+            if(tokens) {
+                p = skip_blank(p, end);
+                while(!is_eol(p, end)) {
+                    ++*tokens;
+                    while(!is_token_end(p, end) && *p!='#')
+                        ++p;
+                    p = skip_blank(p, end);
+                }
+            }
+
+            p = skip_line(p, end);
+        }
+    }
+
+    inline void track_max(uint32_t& max, uint32_t index)
+    {
+        if(index != io::obj_format::none)
+            max = std::max(max, index+1);
+    }
+
+    // Parses the chunk and hands every element to the writer along with
+    // it's index in the file.
+    template <typename Writer>
+    void parse_chunk(chunk_t& chunk, Writer& out)
+    {
+        const char* p = chunk.begin;
+        const char* end = chunk.end;
+        const counts_t& off = chunk.offset;
+        counts_t n;
+        std::string name;
+        std::vector<FFacePoint> points;
+        std::vector<uint32_t> vertices;
+
+        while(p < end)
+        {
+            p = skip_blank(p, end);
+
+            if(p==end)
+                break;
+
+            if(*p=='\n') {
+                ++p;
+                continue;
+            }
+
+            if(*p=='#') {
+                p = skip_line(p, end);
+                continue;
+            }
+
+            // statement keyword
+            const char* k = p;
+            while(!is_token_end(p, end))
+                ++p;
+
+            // elements read so far, used by negative indices
+            uint32_t count[3] = { off.v + n.v, off.st + n.st, off.vn + n.vn };
+            bool ok = true;
+
+            switch(keyword(k, p-k)) {
+                case kV: {
+                    float xyz[3];
+                    ok = parse_floats(p, end, xyz, 3, 3);
+                    out.vertex(off.v + n.v++, FVertex3D(xyz[0], xyz[1], xyz[2]));
+                    break;
+                }
+                case kVT: {
+                    float st[2];
+                    ok = parse_floats(p, end, st, 2, 1);
+                    out.texcoord(off.st + n.st++, FTextureCoord(st[0], st[1]));
+                    break;
+                }
+                case kVN: {
+                    float xyz[3];
+                    ok = parse_floats(p, end, xyz, 3, 3);
+                    out.normal(off.vn + n.vn++, FVertex3D(xyz[0], xyz[1], xyz[2]));
+                    break;
+                }
+                case kF: {
+                    points.clear();
+                    p = skip_blank(p, end);
+                    while(ok && !is_eol(p, end)) {
+                        FFacePoint fp;
+                        ok = parse_facepoint(p, end, count, fp);
+                        if(ok) {
+                            track_max(chunk.maxv, fp.v);
+                            track_max(chunk.maxvt, fp.vt);
+                            track_max(chunk.maxvn, fp.vn);
+                            points.push_back(fp);
+                        }
+                        p = skip_blank(p, end);
+                    }
+                    ok = ok && points.size() >= 3;
+                    if(ok) {
+                        out.face(off.f + n.f++, off.fp + n.fp, points);
+                        n.fp += points.size();
+                    }
+                    break;
+                }
+                case kL:
+                case kP: {
+                    // only the vertex is kept for lines and points
+                    bool line = (k[0]=='l');
+                    vertices.clear();
+                    p = skip_blank(p, end);
+                    while(ok && !is_eol(p, end)) {
+                        FFacePoint fp;
+                        ok = parse_facepoint(p, end, count, fp) && fp.vn == io::obj_format::none;
+                        if(ok) {
+                            track_max(chunk.maxv, fp.v);
+                            vertices.push_back(fp.v);
+                        }
+                        p = skip_blank(p, end);
+                    }
+                    if(line) {
+                        ok = ok && vertices.size() >= 2;
+                        if(ok) {
+                            out.line(off.l + n.l++, off.lv + n.lv, vertices);
+                            n.lv += vertices.size();
+                        }
+                    } else {
+                        ok = ok && vertices.size() >= 1;
+                        if(ok) {
+                            out.point(off.p + n.p, vertices);
+                            n.p += vertices.size();
+                        }
+                    }
+                    break;
+                }
+                case kO: {
+                    counts_t at = off;
+                    at += n;
+                    p = parse_name(p, end, name);
+                    out.object(off.o + n.o++, name, at);
+                    break;
+                }
+                case kG:
+                    // an object started in an earlier chunk is named after
+                    // the parse, other chunks could be naming it too
+                    p = parse_name(p, end, name);
+                    if(n.o)
+                        out.group_name(off.o + n.o - 1, name);
+                    else
+                        chunk.g = name;
+                    break;
+                case kUSEMTL:
+                    p = parse_name(p, end, name);
+                    out.usemtl(off.grp + n.grp++, name, off.f + n.f);
+                    break;
+                case kMTLLIB:
+                    p = parse_name(p, end, name);
+                    out.mtllib(off.mtllib + n.mtllib++, name);
+                    break;
+                case kS: {
+                    int s = 0;
+                    p = skip_blank(p, end);
+                    if(end-p >= 3 && !strncmp(p, "off", 3))
+                        p += 3;
+                    else
+                        ok = parse_int(p, end, s);
+                    out.smoothing(off.sg + n.sg++, s, off.f + n.f);
+                    break;
+                }
+                case kIgnored:
+                    p = skip_line(p, end);
+                    continue;
+                default:
+                    ok = false;
+                    break;
+            }
+
+            p = skip_blank(p, end);
+            if(!ok || !is_eol(p, end)) {
+                chunk.error = k;
+                return;
+            }
+
+            p = skip_line(p, end);
+        }
+    }
+
+    // Writes into the flat mesh_data_t arrays. Sliced writers write into
+    // arrays that have already been sized from the counts, otherwise the
+    // data is appended.
+    template <bool Sliced>
+    class flat_writer
+    {
+        public:
+            flat_writer(io::obj_format::mesh_data_t& data) : _data(data) { };
+
+            void vertex(uint32_t i, const FVertex3D& v) { put(_data.v, i, v); };
+            void texcoord(uint32_t i, const FTextureCoord& st) { put(_data.st, i, st); };
+            void normal(uint32_t i, const FVertex3D& vn) { put(_data.vn, i, vn); };
+
+            void face(uint32_t i, uint32_t fp, const std::vector<FFacePoint>& points) {
+                for(uint32_t j=0; j < points.size(); j++)
+                    put(_data.fp, fp+j, points[j]);
+                put(_data.f, i+1, fp + static_cast<uint32_t>(points.size()));
+            };
+
+            void line(uint32_t i, uint32_t lv, const std::vector<uint32_t>& vertices) {
+                for(uint32_t j=0; j < vertices.size(); j++)
+                    put(_data.lv, lv+j, vertices[j]);
+                put(_data.l, i+1, lv + static_cast<uint32_t>(vertices.size()));
+            };
+
+            void point(uint32_t p, const std::vector<uint32_t>& vertices) {
+                for(uint32_t j=0; j < vertices.size(); j++)
+                    put(_data.p, p+j, vertices[j]);
+            };
+
+            void object(uint32_t i, const std::string& name, const counts_t& at) {
+                if(!Sliced)
+                    _data.object.push_back(io::obj_format::object_t());
+                io::obj_format::object_t& object = _data.object[i];
+                object.o = name;
+                object.v = at.v;
+                object.st = at.st;
+                object.vn = at.vn;
+                object.f = at.f;
+                object.l = at.l;
+                object.p = at.p;
+            };
+
+            void group_name(uint32_t object, const std::string& name) { _data.object[object].g = name; };
+
+            void usemtl(uint32_t i, const std::string& name, uint32_t f) {
+                io::obj_format::group_t grp;
+                grp.usemtl = name;
+                grp.f = f;
+                put(_data.grp, i, grp);
+            };
+
+            void mtllib(uint32_t i, const std::string& name) { put(_data.mtllib, i, name); };
+
+            void smoothing(uint32_t i, int s, uint32_t f) {
+                io::obj_format::smoothing_group_t sg;
+                sg.s = s;
+                sg.f = f;
+                put(_data.sg, i, sg);
+            };
+
+        private:
+            template <typename T>
+            void put(std::vector<T>& array, uint32_t i, const T& value) {
+                if(Sliced)
+                    array[i] = value;
+                else
+                    array.push_back(value);
+            };
+
+            io::obj_format::mesh_data_t& _data;
+    };
+
+    // an object being streamed into a mesh
+    struct stream_object_t {
+        uint32_t v, st, vn, f;
+        io::obj_format::object_size_t size;
+        FMesh* mesh;
+    };
+
+    // Writes straight into the meshes handed out by the sink. Element
+    // indices are global to the file, the object that an index belongs to
+    // is tracked as the chunk moves through the 'o' statements.
+    class stream_writer
+    {
+        public:
+            stream_writer(std::vector<stream_object_t>& objects, int current, uint32_t first)
+                : _objects(objects), _current(current), _first(first) { };
+
+            void vertex(uint32_t i, const FVertex3D& v) {
+                if(stream_object_t* o = get())
+                    if(i >= o->v && i - o->v < o->size.v)
+                        o->mesh->v[i - o->v] = v;
+            };
+
+            void texcoord(uint32_t i, const FTextureCoord& st) {
+                if(stream_object_t* o = get())
+                    if(i >= o->st && i - o->st < o->size.st)
+                        o->mesh->st[i - o->st] = st;
+            };
+
+            void normal(uint32_t i, const FVertex3D& vn) {
+                if(stream_object_t* o = get())
+                    if(i >= o->vn && i - o->vn < o->size.vn)
+                        o->mesh->vn[i - o->vn] = vn;
+            };
+
+            void face(uint32_t i, uint32_t, const std::vector<FFacePoint>& points) {
+                stream_object_t* o = get();
+                if(!o)
+                    return;
+
+                FFace& face = o->mesh->f[i - o->f];
+                face.resize(points.size());
+
+                // faces that use another object's elements can't be made
+                // relative to this object, they are fixed up later
+                bool local = true;
+                for(uint32_t j=0; j < points.size(); j++) {
+                    const FFacePoint& fp = points[j];
+                    local = local && fp.v >= o->v && fp.v - o->v < o->size.v
+                        && (fp.vt == io::obj_format::none || (fp.vt >= o->st && fp.vt - o->st < o->size.st))
+                        && (fp.vn == io::obj_format::none || (fp.vn >= o->vn && fp.vn - o->vn < o->size.vn));
+                    face[j].v = fp.v - o->v;
+                    face[j].vt = (fp.vt == io::obj_format::none) ? 0 : fp.vt - o->st;
+                    face[j].vn = (fp.vn == io::obj_format::none) ? 0 : fp.vn - o->vn;
+                }
+
+                if(!local && (shared.empty() || shared.back() != static_cast<uint32_t>(_current)))
+                    shared.push_back(_current);
+            };
+
+            // meshes don't store lines or points
+            void line(uint32_t, uint32_t, const std::vector<uint32_t>&) { };
+            void point(uint32_t, const std::vector<uint32_t>&) { };
+
+            void object(uint32_t i, const std::string&, const counts_t&) { _current = _first + i; };
+
+            void group_name(uint32_t, const std::string&) { };
+            void usemtl(uint32_t, const std::string&, uint32_t) { };
+            void mtllib(uint32_t, const std::string&) { };
+            void smoothing(uint32_t, int, uint32_t) { };
+
+            // objects with faces that use other object's elements
+            std::vector<uint32_t> shared;
+
+        private:
+            stream_object_t* get() {
+                if(_current < 0 || !_objects[_current].mesh)
+                    return nullptr;
+                return &_objects[_current];
+            };
+
+            std::vector<stream_object_t>& _objects;
+            int _current;
+            uint32_t _first;
+    };
+
+    // the group name given before the first object
+    std::string leading_group(const std::vector<chunk_t>& chunk)
+    {
+        std::string g;
+        for(auto& c : chunk) {
+            if(c.offset.o)
+                break;
+            if(!c.g.empty())
+                g = c.g;
+        }
+        return g;
+    }
+
+    // checks the chunks for errors and bad indices after they are parsed
+    feather::status check(const io::mapped_file& file, const std::vector<chunk_t>& chunk, const counts_t& total)
+    {
+        uint32_t maxv=0, maxvt=0, maxvn=0;
+
+        for(auto& c : chunk) {
+            if(c.error) {
+                // only report the first error in the file
+                size_t offset = c.error - file.begin();
+                size_t line = 1 + std::count(file.begin(), c.error, '\n');
+                const char* eol = static_cast<const char*>(memchr(c.error, '\n', file.end()-c.error));
+                std::string statement(c.error, eol ? eol : file.end());
+                std::stringstream ss;
+                ss << "failed to parse obj at byte " << offset << " (line " << line << "): " << statement.substr(0,80);
+                std::cout << ss.str() << std::endl;
+                return status(FAILED,ss.str());
+            }
+            maxv = std::max(maxv, c.maxv);
+            maxvt = std::max(maxvt, c.maxvt);
+            maxvn = std::max(maxvn, c.maxvn);
+        }
+
+        if(maxv > total.v || maxvt > total.st || maxvn > total.vn) {
+            std::cout << "FAILED TO PARSE OBJ, face index out of range\n";
+            return status(FAILED,"face index out of range");
+        }
+
+        return status();
+    }
+
+    // the faces of every object with the file's indices
+    void merged_faces(const io::obj_format::mesh_data_t& data, FMesh& mesh)
+    {
+        mesh.f.clear();
+        mesh.f.resize(data.face_count());
+
+        for(uint32_t i=0; i < mesh.f.size(); i++) {
+            FFace& face = mesh.f[i];
+            face.resize(data.f[i+1] - data.f[i]);
+            for(uint32_t j=0; j < face.size(); j++) {
+                const FFacePoint& fp = data.fp[data.f[i]+j];
+                face[j].v = fp.v;
+                face[j].vt = (fp.vt == io::obj_format::none) ? 0 : fp.vt;
+                face[j].vn = (fp.vn == io::obj_format::none) ? 0 : fp.vn;
+            }
+        }
+    }
+
+} // namespace
+
+
+std::string io::obj_format::default_name(std::string filename)
+{
+    size_t slash = filename.find_last_of('/');
+    if(slash != std::string::npos)
+        filename.erase(0, slash+1);
+    size_t dot = filename.find_last_of('.');
+    if(dot != std::string::npos && dot)
+        filename.erase(dot);
+    return filename.empty() ? "object" : filename;
+}
+
+feather::status io::obj_format::read(std::string filename, mesh_data_t& data, unsigned int threads)
+{
+    mapped_file file;
+
+    if(!file.open(filename)) {
+        std::cout << "error loading \"" << filename << "\" obj file\n";
+        return status(FAILED,"loading error");
+    }
+
+    data = mesh_data_t();
+    threads = thread_count(threads);
+
+    std::vector<chunk_t> chunk;
+    split(file, threads, chunk);
+
+    counts_t total;
+
+    if(chunk.size()==1) {
+        // everything is read in a single pass
+        data.f.push_back(0);
+        data.l.push_back(0);
+        flat_writer<false> out(data);
+        parse_chunk(chunk[0], out);
+        total.v = data.v.size();
+        total.st = data.st.size();
+        total.vn = data.vn.size();
+    } else {
+        parallel_for(chunk.size(), threads, [&chunk] (unsigned int i) {
+                scan_chunk(chunk[i]);
+                });
+
+        for(auto& c : chunk) {
+            c.offset = total;
+            total += c.count;
+        }
+
+        // every array is sized once, the chunks fill in their own slice
+        data.v.resize(total.v);
+        data.st.resize(total.st);
+        data.vn.resize(total.vn);
+        data.f.resize(total.f+1);
+        data.f[0] = 0;
+        data.fp.resize(total.fp);
+        data.l.resize(total.l+1);
+        data.l[0] = 0;
+        data.lv.resize(total.lv);
+        data.p.resize(total.p);
+        data.object.resize(total.o);
+        data.grp.resize(total.grp);
+        data.sg.resize(total.sg);
+        data.mtllib.resize(total.mtllib);
+
+        parallel_for(chunk.size(), threads, [&chunk,&data] (unsigned int i) {
+                flat_writer<true> out(data);
+                parse_chunk(chunk[i], out);
+                });
+
+        // group names for objects that carry on from an earlier chunk,
+        // applied in file order so the last one given wins
+        for(auto& c : chunk)
+            if(c.offset.o && !c.g.empty())
+                data.object[c.offset.o - 1].g = c.g;
+    }
+
+    status p = check(file, chunk, total);
+    if(p.state==FAILED)
+        return p;
+
+    // anything before the first object gets an object of it's own
+    bool leading = data.face_count() || data.lv.size() || data.p.size();
+    if(!data.object.empty()) {
+        const object_t& first = data.object.front();
+        leading = first.f || first.l || first.p;
+    }
+
+    if(leading) {
+        object_t object;
+        object.g = leading_group(chunk);
+        object.o = object.g.empty() ? default_name(filename) : object.g;
+        object.v = object.st = object.vn = object.f = object.l = object.p = 0;
+        data.object.insert(data.object.begin(), object);
+    }
+
+    std::cout << "obj parsed\n"
+        << "\tchunks: " << chunk.size() << std::endl
+        << "\tobjects: " << data.object.size() << std::endl
+        << "\tv size: " << data.v.size() << std::endl
+        << "\tst size: " << data.st.size() << std::endl
+        << "\tvn size: " << data.vn.size() << std::endl
+        << "\tf size: " << data.face_count() << std::endl
+        << "\tl size: " << data.line_count() << std::endl
+        << "\tp size: " << data.p.size() << std::endl;
+
+    return status();
+}
+
+feather::status io::obj_format::stream(std::string filename, mesh_sink_t& sink, unsigned int threads)
+{
+    mapped_file file;
+
+    if(!file.open(filename)) {
+        std::cout << "error loading \"" << filename << "\" obj file\n";
+        return status(FAILED,"loading error");
+    }
+
+    threads = thread_count(threads);
+
+    std::vector<chunk_t> chunk;
+    split(file, threads, chunk);
+
+    // the scan gives the size of every object before anything is read
+    parallel_for(chunk.size(), threads, [&chunk] (unsigned int i) {
+            scan_chunk(chunk[i]);
+            });
+
+    counts_t total;
+    for(auto& c : chunk) {
+        c.offset = total;
+        total += c.count;
+    }
+
+    std::vector<stream_object_t> objects;
+    std::vector<std::string> names;
+    counts_t first_object = total;
+
+    for(auto& c : chunk) {
+        for(auto& mark : c.objects) {
+            stream_object_t object;
+            counts_t at = c.offset;
+            at += mark.at;
+            if(objects.empty())
+                first_object = at;
+            object.v = at.v;
+            object.st = at.st;
+            object.vn = at.vn;
+            object.f = at.f;
+            object.mesh = nullptr;
+            objects.push_back(object);
+
+            std::string name;
+            parse_name(mark.name, file.end(), name);
+            names.push_back(name);
+        }
+    }
+
+    // anything before the first object gets an object of it's own
+    bool leading = first_object.f || first_object.lv || first_object.p;
+
+    if(leading) {
+        stream_object_t object;
+        object.v = object.st = object.vn = object.f = 0;
+        object.mesh = nullptr;
+        objects.insert(objects.begin(), object);
+        std::string g = leading_group(chunk);
+        names.insert(names.begin(), g.empty() ? default_name(filename) : g);
+    }
+
+    // The meshes are read before the sink hears about any object, a file
+    // that fails to parse part way through mustn't leave half filled
+    // objects behind. They are handed over once the file has checked out.
+    std::vector<FMesh> meshes(objects.size());
+
+    for(uint32_t i=0; i < objects.size(); i++) {
+        bool last = (i+1 == objects.size());
+        object_size_t& size = objects[i].size;
+        size.v = (last ? total.v : objects[i+1].v) - objects[i].v;
+        size.st = (last ? total.st : objects[i+1].st) - objects[i].st;
+        size.vn = (last ? total.vn : objects[i+1].vn) - objects[i].vn;
+        size.f = (last ? total.f : objects[i+1].f) - objects[i].f;
+        objects[i].mesh = &meshes[i];
+    }
+
+    // size every mesh once so the chunks can fill them in place
+    parallel_for(objects.size(), threads, [&objects] (unsigned int i) {
+            stream_object_t& o = objects[i];
+            o.mesh->v.resize(o.size.v);
+            o.mesh->st.resize(o.size.st);
+            o.mesh->vn.resize(o.size.vn);
+            o.mesh->f.resize(o.size.f);
+            });
+
+    std::vector<std::vector<uint32_t>> shared(chunk.size());
+    uint32_t first = leading ? 1 : 0;
+
+    parallel_for(chunk.size(), threads, [&chunk,&objects,&shared,first] (unsigned int i) {
+            // the object this chunk starts in
+            int current = static_cast<int>(chunk[i].offset.o + first) - 1;
+            stream_writer out(objects, current, first);
+            parse_chunk(chunk[i], out);
+            shared[i].swap(out.shared);
+            });
+
+    status p = check(file, chunk, total);
+    if(p.state==FAILED)
+        return p;
+
+    // Objects that use another object's elements can't be streamed, read
+    // the whole file and copy out only what those objects use.
+    std::vector<uint32_t> fixup;
+    for(auto& s : shared)
+        fixup.insert(fixup.end(), s.begin(), s.end());
+
+    if(!fixup.empty()) {
+        std::cout << fixup.size() << " objects share elements, reading the whole file\n";
+        mesh_data_t data;
+        p = read(filename, data, threads);
+        if(p.state==FAILED)
+            return p;
+        for(uint32_t i : fixup) {
+            FMesh* mesh = objects[i].mesh;
+            mesh->f.clear();
+            get_mesh(data, i, *mesh);
+        }
+    }
+
+    for(uint32_t i=0; i < objects.size(); i++)
+        sink.object(i, names[i], objects[i].size);
+
+    // the sink can only hand out the meshes once every object exists
+    for(uint32_t i=0; i < objects.size(); i++) {
+        FMesh* mesh = sink.mesh(i);
+        if(!mesh)
+            continue;
+        mesh->v.swap(meshes[i].v);
+        mesh->st.swap(meshes[i].st);
+        mesh->vn.swap(meshes[i].vn);
+        mesh->f.swap(meshes[i].f);
+    }
+
+    std::cout << "obj streamed\n"
+        << "\tchunks: " << chunk.size() << std::endl
+        << "\tobjects: " << objects.size() << std::endl
+        << "\tv size: " << total.v << std::endl
+        << "\tst size: " << total.st << std::endl
+        << "\tvn size: " << total.vn << std::endl
+        << "\tf size: " << total.f << std::endl;
+
+    return status();
+}
+
+void io::obj_format::get_mesh(const mesh_data_t& data, unsigned int object, feather::FMesh& mesh)
+{
+    const object_t& obj = data.object.at(object);
+    bool last = (object+1 == data.object.size());
+
+    uint32_t vend = last ? data.v.size() : data.object[object+1].v;
+    uint32_t stend = last ? data.st.size() : data.object[object+1].st;
+    uint32_t vnend = last ? data.vn.size() : data.object[object+1].vn;
+    uint32_t fend = last ? data.face_count() : data.object[object+1].f;
+
+    // faces normally only use their own object's elements
+    bool local = true;
+    for(uint32_t i=data.f[obj.f]; local && i < data.f[fend]; i++) {
+        const FFacePoint& fp = data.fp[i];
+        local = (fp.v >= obj.v && fp.v < vend)
+            && (fp.vt == none || (fp.vt >= obj.st && fp.vt < stend))
+            && (fp.vn == none || (fp.vn >= obj.vn && fp.vn < vnend));
+    }
+
+    mesh.f.reserve(mesh.f.size() + fend - obj.f);
+
+    if(local) {
+        mesh.v.assign(data.v.begin()+obj.v, data.v.begin()+vend);
+        mesh.st.assign(data.st.begin()+obj.st, data.st.begin()+stend);
+        mesh.vn.assign(data.vn.begin()+obj.vn, data.vn.begin()+vnend);
+
+        // the face points are global to the file, make them relative to the object
+        for(uint32_t i=obj.f; i < fend; i++) {
+            FFace face(data.f[i+1] - data.f[i]);
+            for(uint32_t j=0; j < face.size(); j++) {
+                const FFacePoint& fp = data.fp[data.f[i]+j];
+                face[j].v = fp.v - obj.v;
+                face[j].vt = (fp.vt == none) ? 0 : fp.vt - obj.st;
+                face[j].vn = (fp.vn == none) ? 0 : fp.vn - obj.vn;
+            }
+            mesh.f.push_back(face);
+        }
+        return;
+    }
+
+    // The file shares it's elements between objects (usually one vertex
+    // list for every group), only copy the elements this object uses.
+    mesh.v.clear();
+    mesh.st.clear();
+    mesh.vn.clear();
+
+    std::unordered_map<uint32_t,uint32_t> vmap, stmap, vnmap;
+
+    auto remap = [] (std::unordered_map<uint32_t,uint32_t>& map, uint32_t index, uint32_t next) -> std::pair<uint32_t,bool> {
+        auto it = map.insert(std::make_pair(index, next));
+        return std::make_pair(it.first->second, it.second);
+    };
+
+    for(uint32_t i=obj.f; i < fend; i++) {
+        FFace face(data.f[i+1] - data.f[i]);
+        for(uint32_t j=0; j < face.size(); j++) {
+            const FFacePoint& fp = data.fp[data.f[i]+j];
+
+            auto v = remap(vmap, fp.v, mesh.v.size());
+            if(v.second)
+                mesh.v.push_back(data.v[fp.v]);
+            face[j].v = v.first;
+
+            if(fp.vt != none) {
+                auto vt = remap(stmap, fp.vt, mesh.st.size());
+                if(vt.second)
+                    mesh.st.push_back(data.st[fp.vt]);
+                face[j].vt = vt.first;
+            }
+
+            if(fp.vn != none) {
+                auto vn = remap(vnmap, fp.vn, mesh.vn.size());
+                if(vn.second)
+                    mesh.vn.push_back(data.vn[fp.vn]);
+                face[j].vn = vn.first;
+            }
+        }
+        mesh.f.push_back(face);
+    }
+}
+
+void io::obj_format::get_mesh(const mesh_data_t& data, feather::FMesh& mesh)
+{
+    // the arrays are already global to the file
+    mesh.v = data.v;
+    mesh.st = data.st;
+    mesh.vn = data.vn;
+    merged_faces(data, mesh);
+}
+
+void io::obj_format::get_mesh(mesh_data_t&& data, feather::FMesh& mesh)
+{
+    mesh.v.swap(data.v);
+    mesh.st.swap(data.st);
+    mesh.vn.swap(data.vn);
+    merged_faces(data, mesh);
+}
@@ -0,0 +1,153 @@
+/***********************************************************************
+ *
+ * Filename: obj.hpp
+ *
+ * Description: Fast reader for obj files.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#ifndef OBJ_HPP
+#define OBJ_HPP
+
+#include <feather/types.hpp>
+#include <feather/deps.hpp>
+#include <feather/status.hpp>
+
+namespace io
+{
+
+/*
+ * OBJ FORMAT
+ *
+ * The file is memory mapped and tokenized a line at a time. All of the
+ * geometry goes straight into flat arrays that are shared by every object
+ * in the file, objects and groups only store the index of their first
+ * element. The next object (or the end of the array) marks where they end.
+ *
+ * [v]      all vertex positions in the file
+ * [st]     all texture coords in the file
+ * [vn]     all normals in the file
+ * [f]      index of each face's first face point, plus one for the end
+ * [fp]     all face points, 0 based and global to the file
+ * [l]      index of each line's first vertex, plus one for the end
+ * [lv]     all line vertices
+ * [p]      all point vertices
+ *
+ * Every face point form (v, v/vt, v//vn, v/vt/vn) and negative relative
+ * indices are read. Face points without a vt or vn have it set to none.
+ * Anything given before the first 'o' is put in an object named after the
+ * file. Free-form curve and surface statements are skipped.
+ *
+ * This replaces the spirit grammar in io.hpp which is still available
+ * through io::file<IMPORT,OBJ> as a reference.
+ */
+    namespace obj_format
+    {
+
+        // face point index that wasn't given in the file
+        const uint32_t none = 0xffffffff;
+
+        struct object_t {
+            std::string o;
+            std::string g;
+            uint32_t v;     // first vertex
+            uint32_t st;    // first texture coord
+            uint32_t vn;    // first normal
+            uint32_t f;     // first face
+            uint32_t l;     // first line
+            uint32_t p;     // first point
+        };
+
+        struct group_t {
+            std::string usemtl;
+            uint32_t f;     // first face
+        };
+
+        struct smoothing_group_t {
+            int s;
+            uint32_t f;     // first face
+        };
+
+        struct mesh_data_t {
+            std::vector<std::string> mtllib;
+            feather::FVertex3DArray v;
+            feather::FTextureCoordArray st;
+            feather::FVertex3DArray vn;
+            std::vector<uint32_t> f;
+            std::vector<feather::FFacePoint> fp;
+            std::vector<uint32_t> l;
+            std::vector<uint32_t> lv;
+            std::vector<uint32_t> p;
+            std::vector<object_t> object;
+            std::vector<group_t> grp;
+            std::vector<smoothing_group_t> sg;
+
+            uint32_t face_count() const { return f.empty() ? 0 : f.size()-1; };
+            uint32_t line_count() const { return l.empty() ? 0 : l.size()-1; };
+        };
+
+        // large files are split at line boundaries and read on up to
+        // threads workers, 0 uses every core and 1 reads in a single pass
+        feather::status read(std::string filename, mesh_data_t& data, unsigned int threads=0);
+
+        // fills in the mesh with one object's data, face indices will be
+        // relative to the object instead of the file and missing indices 0
+        void get_mesh(const mesh_data_t& data, unsigned int object, feather::FMesh& mesh);
+
+        // fills in the mesh with every object in the file merged together
+        void get_mesh(const mesh_data_t& data, feather::FMesh& mesh);
+
+        // same as above but the v, st and vn arrays are moved out of data
+        void get_mesh(mesh_data_t&& data, feather::FMesh& mesh);
+
+        // name of the object that holds anything given before the first
+        // 'o', this is the file name without it's path or extension
+        std::string default_name(std::string filename);
+
+        // number of elements in an object
+        struct object_size_t {
+            uint32_t v;
+            uint32_t st;
+            uint32_t vn;
+            uint32_t f;
+        };
+
+        // Receives the objects from stream(). Every object is announced
+        // first with it's size so the nodes can be made, after that the
+        // sink is asked for the mesh each object is read into. A null mesh
+        // skips the object.
+        class mesh_sink_t
+        {
+            public:
+                virtual ~mesh_sink_t() { };
+                virtual void object(unsigned int index, const std::string& name, const object_size_t& size) = 0;
+                virtual feather::FMesh* mesh(unsigned int index) = 0;
+        };
+
+        // Reads each object straight into it's mesh without keeping the
+        // whole file in a mesh_data_t. The meshes are sized from a scan of
+        // the file and filled in place by the chunks. Objects that use
+        // another object's vertices fall back to read() and get_mesh().
+        // The sink isn't given any objects if the file fails to parse.
+        feather::status stream(std::string filename, mesh_sink_t& sink, unsigned int threads=0);
+
+    } // namespace obj_format
+
+} // namespace io
+
+#endif
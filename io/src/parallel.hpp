@@ -0,0 +1,126 @@
+/***********************************************************************
+ *
+ * Filename: parallel.hpp
+ *
+ * Description: Simple worker pool used to split io work across cores.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace io
+{
+
+    // returns the number of worker threads to use, 0 means use every core
+    inline unsigned int thread_count(unsigned int threads=0)
+    {
+        if(threads)
+            return threads;
+        unsigned int cores = std::thread::hardware_concurrency();
+        return cores ? cores : 1;
+    }
+
+    // Calls fn(i) for every i in [0,count) using up to threads workers.
+    // Each worker pulls the next index when it's done with the last one so
+    // uneven jobs still keep every core busy. The calling thread is used as
+    // one of the workers and the call returns when all the jobs are done.
+    template <typename Function>
+    void parallel_for(unsigned int count, unsigned int threads, Function fn)
+    {
+        threads = std::min(thread_count(threads), count);
+
+        if(threads <= 1) {
+            for(unsigned int i=0; i < count; i++)
+                fn(i);
+            return;
+        }
+
+        std::atomic<unsigned int> next(0);
+
+        auto worker = [&next,count,&fn] () {
+            unsigned int i;
+            while((i = next++) < count)
+                fn(i);
+        };
+
+        std::vector<std::thread> pool;
+        for(unsigned int i=1; i < threads; i++)
+            pool.push_back(std::thread(worker));
+
+        worker();
+
+        for(auto& t : pool)
+            t.join();
+    }
+
+    // Queue between one stage of a pipeline and the next. push() waits
+    // while the queue is full so a fast producer can't run too far ahead
+    // of the consumers, pop() waits for the next item and returns false
+    // once the queue is closed and empty.
+    template <typename T>
+    class bounded_queue
+    {
+        public:
+            bounded_queue(size_t capacity) : _capacity(std::max<size_t>(capacity, 1)), _closed(false) { };
+
+            void push(T item) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _not_full.wait(lock, [this] () { return _items.size() < _capacity; });
+                _items.push_back(std::move(item));
+                _not_empty.notify_one();
+            };
+
+            bool pop(T& item) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _not_empty.wait(lock, [this] () { return !_items.empty() || _closed; });
+                if(_items.empty())
+                    return false;
+                item = std::move(_items.front());
+                _items.pop_front();
+                _not_full.notify_one();
+                return true;
+            };
+
+            // no more items will be pushed
+            void close() {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _closed = true;
+                _not_empty.notify_all();
+            };
+
+        private:
+            std::deque<T> _items;
+            size_t _capacity;
+            bool _closed;
+            std::mutex _mutex;
+            std::condition_variable _not_full;
+            std::condition_variable _not_empty;
+    };
+
+} // namespace io
+
+#endif
@@ -0,0 +1,254 @@
+/***********************************************************************
+ *
+ * Filename: track.cpp
+ *
+ * Description: Binary camera track files.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#include "track.hpp"
+
+using namespace feather;
+using namespace io::track_format;
+
+namespace
+{
+
+    const char magic[4] = { 'F', 'C', 'T', '\0' };
+
+    static_assert(sizeof(header_t) == 32, "header_t has to match the file");
+    static_assert(sizeof(channel_t) == 8, "channel_t has to match the file");
+
+    void put_name(io::write_buffer& buffer, const std::string& name)
+    {
+        buffer.append(name);
+        for(size_t i=name.size(); i < io::padded(name.size()); i++)
+            buffer.put('\0');
+    }
+
+    // reads a name padded to 4 bytes, false if it runs past the end
+    bool get_name(const char* begin, uint64_t& p, uint64_t end, uint32_t length, std::string& name)
+    {
+        if(io::padded(length) > end - p)
+            return false;
+        name.assign(begin+p, length);
+        p += io::padded(length);
+        return true;
+    }
+
+} // namespace
+
+
+status io::track_format::writer::open(std::string filename, const std::vector<std::string>& cameras, const std::vector<channel_info_t>& channels, float fps)
+{
+    _filename = filename;
+    _camera = cameras;
+    _channel = channels;
+    _fps = fps;
+    _frame.clear();
+    _values.clear();
+    _open = true;
+    return status();
+}
+
+status io::track_format::writer::write_frame(int frame, const std::vector<double>& values)
+{
+    if(!_open)
+        return status(FAILED,"track file isn't open");
+
+    if(values.size() != _camera.size() * _channel.size())
+        return status(FAILED,"wrong number of values for the track frame");
+
+    _frame.push_back(frame);
+    _values.insert(_values.end(), values.begin(), values.end());
+    return status();
+}
+
+status io::track_format::writer::close()
+{
+    if(!_open)
+        return status(FAILED,"track file isn't open");
+    _open = false;
+
+    header_t header;
+    memcpy(header.magic, magic, 4);
+    header.version = version;
+    header.cameras = _camera.size();
+    header.channels = _channel.size();
+    header.frames = _frame.size();
+    header.fps = _fps;
+
+    // the names and frame numbers come before the data
+    header.data = sizeof(header_t) + _frame.size()*4;
+    for(auto& name : _camera)
+        header.data += 4 + padded(name.size());
+    for(auto& channel : _channel)
+        header.data += sizeof(channel_t) + padded(channel.name.size());
+    header.data = padded(header.data, 8);
+
+    size_t row = _camera.size() * _channel.size();
+    size_t frames = _frame.size();
+
+    write_buffer buffer;
+    buffer.reserve(header.data + row*frames*sizeof(double));
+
+    buffer.append(header.magic, 4);
+    buffer.put_binary(header.version);
+    buffer.put_binary(header.cameras);
+    buffer.put_binary(header.channels);
+    buffer.put_binary(header.frames);
+    buffer.put_binary(header.fps);
+    buffer.put_binary(header.data);
+
+    for(auto& name : _camera) {
+        buffer.put_binary<uint32_t>(name.size());
+        put_name(buffer, name);
+    }
+
+    for(auto& channel : _channel) {
+        buffer.put_binary<uint32_t>(channel.fid);
+        buffer.put_binary<uint32_t>(channel.name.size());
+        put_name(buffer, channel.name);
+    }
+
+    buffer.put_binary(_frame.data(), _frame.size());
+    while(buffer.size() < header.data)
+        buffer.put('\0');
+
+    // turn the rows into a column for each camera's channel
+    std::vector<double> column(frames);
+    for(size_t i=0; i < row; i++) {
+        for(size_t f=0; f < frames; f++)
+            column[f] = _values[f*row + i];
+        buffer.put_binary(column.data(), frames);
+    }
+
+    _values.clear();
+    _frame.clear();
+
+    if(!buffer.write(_filename)) {
+        std::cout << "error writing \"" << _filename << "\" track file\n";
+        return status(FAILED,"failed to write track file");
+    }
+
+    return status();
+}
+
+
+status io::track_format::reader::open(std::string filename)
+{
+    _camera.clear();
+    _channel.clear();
+    _header = header_t();
+    _frame = nullptr;
+
+    if(!_file.open(filename)) {
+        std::cout << "error loading \"" << filename << "\" track file\n";
+        return status(FAILED,"loading error");
+    }
+
+    const char* begin = _file.begin();
+    uint64_t size = _file.size();
+
+    if(size < sizeof(header_t) || memcmp(begin, magic, 4))
+        return status(FAILED,"not a track file");
+
+    _header.version = get_binary<uint32_t>(begin+4);
+    _header.cameras = get_binary<uint32_t>(begin+8);
+    _header.channels = get_binary<uint32_t>(begin+12);
+    _header.frames = get_binary<uint32_t>(begin+16);
+    _header.fps = get_binary<float>(begin+20);
+    _header.data = get_binary<uint64_t>(begin+24);
+
+    if(_header.version != version)
+        return status(FAILED,"unknown track version");
+
+    uint64_t tracks = uint64_t(_header.cameras) * _header.channels;
+    if(_header.data < sizeof(header_t) || _header.data > size || (size - _header.data) / sizeof(double) / std::max<uint64_t>(_header.frames,1) < tracks)
+        return status(FAILED,"track data is truncated");
+
+    uint64_t p = sizeof(header_t);
+    uint64_t end = _header.data;
+
+    for(uint32_t i=0; i < _header.cameras; i++) {
+        if(end - p < 4)
+            return status(FAILED,"track camera names are truncated");
+        uint32_t length = get_binary<uint32_t>(begin+p);
+        p += 4;
+        std::string name;
+        if(!get_name(begin, p, end, length, name))
+            return status(FAILED,"track camera names are truncated");
+        _camera.push_back(name);
+    }
+
+    for(uint32_t i=0; i < _header.channels; i++) {
+        if(end - p < sizeof(channel_t))
+            return status(FAILED,"track channels are truncated");
+        channel_info_t channel;
+        channel.fid = get_binary<uint32_t>(begin+p);
+        uint32_t length = get_binary<uint32_t>(begin+p+4);
+        p += sizeof(channel_t);
+        if(!get_name(begin, p, end, length, channel.name))
+            return status(FAILED,"track channels are truncated");
+        _channel.push_back(channel);
+    }
+
+    if((end - p) / 4 < _header.frames)
+        return status(FAILED,"track frames are truncated");
+    _frame = begin+p;
+
+    return status();
+}
+
+int io::track_format::reader::find_camera(std::string name) const
+{
+    for(unsigned int i=0; i < _camera.size(); i++)
+        if(_camera[i] == name)
+            return i;
+    return -1;
+}
+
+int io::track_format::reader::find_channel(std::string name) const
+{
+    for(unsigned int i=0; i < _channel.size(); i++)
+        if(_channel[i].name == name)
+            return i;
+    return -1;
+}
+
+int io::track_format::reader::frame(unsigned int index) const
+{
+    return get_binary<int32_t>(_frame + index*4);
+}
+
+const char* io::track_format::reader::track(unsigned int camera, unsigned int channel) const
+{
+    uint64_t index = uint64_t(camera) * _header.channels + channel;
+    return _file.begin() + _header.data + index * _header.frames * sizeof(double);
+}
+
+double io::track_format::reader::value(unsigned int camera, unsigned int channel, unsigned int index) const
+{
+    return get_binary<double>(track(camera,channel) + index*sizeof(double));
+}
+
+void io::track_format::reader::get_track(unsigned int camera, unsigned int channel, std::vector<double>& values) const
+{
+    values.resize(_header.frames);
+    get_binary(track(camera,channel), values.data(), values.size());
+}
@@ -0,0 +1,142 @@
+/***********************************************************************
+ *
+ * Filename: track.hpp
+ *
+ * Description: Binary camera track files.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+#ifndef TRACK_HPP
+#define TRACK_HPP
+
+#include <feather/deps.hpp>
+#include <feather/status.hpp>
+#include "mmap.hpp"
+#include "buffer.hpp"
+
+namespace io
+{
+
+/*
+ * TRACK FORMAT
+ *
+ * [header_t]
+ * CAMERAS
+ *      [uint32]        // name length
+ *      [name]          // padded to 4 bytes
+ *      ...             // number of cameras based on header_t.cameras
+ * CHANNELS
+ *      [channel_t]
+ *      [name]          // padded to 4 bytes
+ *      ...             // number of channels based on header_t.channels
+ * [frames]             // int32 frame numbers, padded to 8 bytes
+ * DATA                 // starts at header_t.data
+ *      [double]        // every frame of the first camera's first channel
+ *      ...             // the rest of the first camera's channels, then the next camera
+ *
+ * The data is column oriented so a reader that only wants one channel of
+ * one camera reads a single contiguous array. Every camera has the same
+ * channels. Everything is little endian.
+ */
+    namespace track_format
+    {
+
+        const uint32_t version = 1;
+
+        struct header_t {
+            char magic[4];          // "FCT\0"
+            uint32_t version;
+            uint32_t cameras;
+            uint32_t channels;
+            uint32_t frames;
+            float fps;
+            uint64_t data;          // offset of the first track
+        };
+
+        struct channel_t {
+            uint32_t fid;           // field the channel was read from
+            uint32_t namelength;
+        };
+
+        // describes a channel for the writer
+        struct channel_info_t {
+            std::string name;
+            unsigned int fid;
+        };
+
+        // Collects every frame in memory and writes the file when it's closed,
+        // the data has to be turned into columns before it can be written.
+        class writer
+        {
+            public:
+                feather::status open(std::string filename, const std::vector<std::string>& cameras, const std::vector<channel_info_t>& channels, float fps);
+                // values has every channel of the first camera, then the next
+                // camera in the order given to open()
+                feather::status write_frame(int frame, const std::vector<double>& values);
+                feather::status close();
+
+            private:
+                std::string _filename;
+                std::vector<std::string> _camera;
+                std::vector<channel_info_t> _channel;
+                std::vector<int32_t> _frame;
+                std::vector<double> _values;    // one row for each frame
+                float _fps = 0;
+                bool _open = false;
+        };
+
+        // Maps the file and only checks the header and names when it opens,
+        // the values are read straight out of the mapping when asked for.
+        class reader
+        {
+            public:
+                feather::status open(std::string filename);
+
+                unsigned int camera_count() const { return _header.cameras; };
+                unsigned int channel_count() const { return _header.channels; };
+                unsigned int frame_count() const { return _header.frames; };
+                float fps() const { return _header.fps; };
+                const std::string& camera(unsigned int index) const { return _camera.at(index); };
+                const std::string& channel(unsigned int index) const { return _channel.at(index).name; };
+                unsigned int channel_fid(unsigned int index) const { return _channel.at(index).fid; };
+
+                // index of the name or -1 if it's not in the file
+                int find_camera(std::string name) const;
+                int find_channel(std::string name) const;
+
+                // frame number of the frame at index
+                int frame(unsigned int index) const;
+                double value(unsigned int camera, unsigned int channel, unsigned int index) const;
+                // copies every frame of a camera's channel
+                void get_track(unsigned int camera, unsigned int channel, std::vector<double>& values) const;
+
+            private:
+                const char* track(unsigned int camera, unsigned int channel) const;
+
+                mapped_file _file;
+                header_t _header = header_t();
+                std::vector<std::string> _camera;
+                std::vector<channel_info_t> _channel;
+                const char* _frame = nullptr;
+        };
+
+    } // namespace track_format
+
+} // namespace io
+
+#endif
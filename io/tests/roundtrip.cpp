@@ -0,0 +1,376 @@
+/***********************************************************************
+ *
+ * Filename: roundtrip.cpp
+ *
+ * Description: Golden file regression tests for the io formats.
+ *
+ * Copyright (C) 2016 Richard Layman, rlayman2000@yahoo.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ***********************************************************************/
+
+/*
+ * io_roundtrip <tests directory> [--update]
+ *
+ * Reads cube.obj and checks what each format makes from it against the
+ * golden files next to it:
+ *
+ *   cube_ascii.ply     format_ply() ascii output of the imported cube
+ *   cube_binary.ply    format_ply() binary output of the imported cube
+ *   cube.fct           a small camera track file with known values
+ *   cube.fpc           a point cache of the cube moving over a few frames
+ *   cube.mesh          the cube written as a mesh container
+ *   cube.feather       a scene with the cube in a mesh node
+ *
+ * The ply, fct, fpc and mesh files have to match byte for byte and are
+ * read back with their readers. cube.feather is opened into the scene
+ * with feather_format::open(), in full and lazily, and the mesh node has
+ * to come back with the cube. The scene is saved and opened again, once
+ * compressed with a mesh big enough to be split into blocks. The obj
+ * writer is checked by reading it's output back in. --update writes every
+ * golden again after a format change on purpose.
+ */
+
+#include "io.hpp"
+#include <feather/field.hpp>
+#include <feather/plugin.hpp>
+#include <functional>
+#include <cstring>
+#include <cstdio>
+
+using namespace feather;
+
+namespace
+{
+
+    int failures = 0;
+
+    void check(bool ok, std::string what)
+    {
+        std::cout << (ok ? "ok     " : "FAILED ") << what << std::endl;
+        if(!ok)
+            failures++;
+    }
+
+    bool read_file(std::string filename, std::string& data)
+    {
+        std::ifstream file(filename.c_str(), std::ios::in|std::ios::binary);
+        if(!file.is_open())
+            return false;
+        std::stringstream ss;
+        ss << file.rdbuf();
+        data = ss.str();
+        return true;
+    }
+
+    bool write_file(std::string filename, const char* data, size_t size)
+    {
+        std::ofstream file(filename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+        file.write(data, size);
+        return !file.fail();
+    }
+
+    // the output has to match the golden byte for byte, or becomes the
+    // golden when updating
+    void check_golden(std::string filename, const char* data, size_t size, bool update)
+    {
+        if(update) {
+            check(write_file(filename, data, size), "update " + filename);
+            return;
+        }
+        std::string golden;
+        check(read_file(filename, golden) && golden.size() == size && !memcmp(golden.data(), data, size), "match " + filename);
+    }
+
+    bool same_vertex(const FVertex3D& a, const FVertex3D& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+    bool same_mesh(const FMesh& a, const FMesh& b)
+    {
+        if(a.v.size() != b.v.size() || a.st.size() != b.st.size() || a.vn.size() != b.vn.size() || a.f.size() != b.f.size())
+            return false;
+        for(size_t i=0; i < a.v.size(); i++)
+            if(!same_vertex(a.v[i], b.v[i]))
+                return false;
+        for(size_t i=0; i < a.st.size(); i++)
+            if(a.st[i].s != b.st[i].s || a.st[i].t != b.st[i].t)
+                return false;
+        for(size_t i=0; i < a.vn.size(); i++)
+            if(!same_vertex(a.vn[i], b.vn[i]))
+                return false;
+        for(size_t i=0; i < a.f.size(); i++) {
+            if(a.f[i].size() != b.f[i].size())
+                return false;
+            for(size_t j=0; j < a.f[i].size(); j++)
+                if(a.f[i][j].v != b.f[i][j].v || a.f[i][j].vt != b.f[i][j].vt || a.f[i][j].vn != b.f[i][j].vn)
+                    return false;
+        }
+        return true;
+    }
+
+    bool import_obj(std::string filename, FMesh& mesh)
+    {
+        io::obj_format::mesh_data_t data;
+        if(io::obj_format::read(filename, data, 1).state == FAILED || data.object.size() != 1)
+            return false;
+        io::obj_format::get_mesh(data, 0, mesh);
+        return true;
+    }
+
+    // Writes a file with write(filename). When updating it's written
+    // straight over the golden, otherwise it's written next to the test and
+    // has to match the golden.
+    void check_written(std::string directory, std::string name, bool update, std::function<bool(std::string)> write)
+    {
+        std::string filename = update ? directory + "/" + name : "io_roundtrip_" + name;
+        check(write(filename), "write " + name);
+        if(update)
+            return;
+
+        std::string data;
+        check(read_file(filename, data), "read written " + name);
+        check_golden(directory + "/" + name, data.data(), data.size(), false);
+        std::remove(filename.c_str());
+    }
+
+    void test_ply(std::string directory, const FMesh& cube, bool update)
+    {
+        for(bool binary : { false, true }) {
+            io::write_buffer buffer;
+            check(io::format_ply(cube, binary, false, buffer), binary ? "format binary ply" : "format ascii ply");
+            check_golden(directory + (binary ? "/cube_binary.ply" : "/cube_ascii.ply"), buffer.data(), buffer.size(), update);
+        }
+    }
+
+    void test_obj_export(const FMesh& cube)
+    {
+        std::string filename = "io_roundtrip_cube.obj";
+        std::vector<std::string> names(1, "cube");
+        std::vector<const FMesh*> meshes(1, &cube);
+        check(io::write_obj(filename, names, meshes), "write obj");
+
+        FMesh mesh;
+        check(import_obj(filename, mesh) && same_mesh(mesh, cube), "read back written obj");
+        std::remove(filename.c_str());
+    }
+
+    // two cameras with every channel set from the frame, camera and channel
+    void test_tracks(std::string directory, bool update)
+    {
+        std::vector<std::string> cameras = { "front", "side" };
+        std::vector<io::track_format::channel_info_t> channels = {
+            { "tx", 214 }, { "ty", 215 }, { "tz", 216 },
+            { "rx", 217 }, { "ry", 218 }, { "rz", 219 },
+            { "fov", 2 }, { "near", 3 }, { "far", 4 }
+        };
+        const int frames = 5;
+
+        check_written(directory, "cube.fct", update, [&] (std::string filename) {
+            io::track_format::writer writer;
+            bool ok = writer.open(filename, cameras, channels, 24).state != FAILED;
+            std::vector<double> values(cameras.size()*channels.size());
+            for(int f=1; ok && f <= frames; f++) {
+                for(size_t i=0; i < values.size(); i++)
+                    values[i] = f*100.0 + i*0.25;
+                ok = writer.write_frame(f, values).state != FAILED;
+            }
+            return ok && writer.close().state != FAILED;
+        });
+
+        io::track_format::reader reader;
+        bool ok = reader.open(directory + "/cube.fct").state != FAILED
+            && reader.camera_count() == cameras.size()
+            && reader.channel_count() == channels.size()
+            && reader.frame_count() == unsigned(frames)
+            && reader.fps() == 24
+            && reader.camera(1) == "side"
+            && reader.channel_fid(6) == 2;
+        for(unsigned int c=0; ok && c < cameras.size(); c++)
+            for(unsigned int ch=0; ok && ch < channels.size(); ch++)
+                for(int f=0; ok && f < frames; f++)
+                    ok = reader.frame(f) == f+1 && reader.value(c, ch, f) == (f+1)*100.0 + (c*channels.size() + ch)*0.25;
+        check(ok, "read cube.fct");
+    }
+
+    // the cube moved up by the frame number
+    FMesh moved(const FMesh& cube, int frame)
+    {
+        FMesh mesh = cube;
+        for(auto& v : mesh.v)
+            v.y += frame;
+        return mesh;
+    }
+
+    // the cube over three frames, with normals
+    void test_cache(std::string directory, const FMesh& cube, bool update)
+    {
+        const int frames = 3;
+
+        check_written(directory, "cube.fpc", update, [&] (std::string filename) {
+            io::cache_format::writer writer;
+            bool ok = writer.open(filename, true, 24).state != FAILED
+                && writer.add_shape("cube_shape", cube).state != FAILED;
+            for(int f=1; ok && f <= frames; f++) {
+                FMesh mesh = moved(cube, f);
+                std::vector<const FMesh*> meshes(1, &mesh);
+                ok = writer.write_frame(f, meshes).state != FAILED;
+            }
+            return ok && writer.close().state != FAILED;
+        });
+
+        io::cache_format::reader reader;
+        bool ok = reader.open(directory + "/cube.fpc").state != FAILED
+            && reader.shape_count() == 1
+            && reader.frame_count() == unsigned(frames)
+            && reader.has_normals()
+            && reader.fps() == 24
+            && reader.name(0) == "cube_shape"
+            && reader.vertex_count(0) == cube.v.size()
+            && reader.find_frame(frames+1) < 0;
+
+        // frames are read out of order so each one is found on it's own
+        FMesh mesh;
+        if(ok)
+            reader.get_topology(0, mesh);
+        for(int f=frames; ok && f >= 1; f--) {
+            int index = reader.find_frame(f);
+            ok = index >= 0 && reader.frame(index) == f;
+            if(ok) {
+                reader.get_frame(index, 0, mesh);
+                ok = same_mesh(mesh, moved(cube, f));
+            }
+        }
+        check(ok, "read cube.fpc");
+    }
+
+    void test_mesh(std::string directory, const FMesh& cube, bool update)
+    {
+        check_written(directory, "cube.mesh", update, [&] (std::string filename) {
+            return io::mesh_format::write(filename, "cube", cube).state != FAILED;
+        });
+
+        io::mesh_format::reader reader;
+        FMesh mesh;
+        bool ok = reader.open(directory + "/cube.mesh").state != FAILED
+            && reader.name() == "cube"
+            && reader.vertex_count() == cube.v.size()
+            && reader.face_count() == cube.f.size();
+        if(ok)
+            reader.get_mesh(mesh);
+        check(ok && same_mesh(mesh, cube), "read cube.mesh");
+    }
+
+    // a mesh node called name with mesh in it and a shape node under it,
+    // connected the way the obj import connects them
+    void add_mesh_node(std::string name, const FMesh& mesh)
+    {
+        status p;
+        unsigned int meshuid = plugin::add_node(324, name, p);
+        unsigned int shapeuid = plugin::add_node(320, name + "_shape", p);
+        static_cast<field::Field<FMesh>*>(plugin::get_field_base(meshuid, 1))->value = mesh;
+        plugin::connect(0, 202, meshuid, 201);
+        plugin::connect(meshuid, 202, shapeuid, 201);
+        plugin::connect(meshuid, 2, shapeuid, 1);
+    }
+
+    // the mesh in the node called name after an open
+    bool scene_mesh(std::string name, const FMesh& mesh)
+    {
+        status p;
+        unsigned int uid = 0;
+        if(!plugin::get_node_by_name(name, uid) || plugin::get_node_id(uid, p) != 324)
+            return false;
+        field::Field<FMesh>* field = static_cast<field::Field<FMesh>*>(plugin::get_field_base(uid, 1));
+        return field && same_mesh(field->value, mesh);
+    }
+
+    // a flat grid big enough that it's arrays are split into blocks
+    FMesh grid(unsigned int size)
+    {
+        FMesh mesh;
+        for(unsigned int y=0; y <= size; y++)
+            for(unsigned int x=0; x <= size; x++) {
+                mesh.v.push_back(FVertex3D(x, 0, y));
+                mesh.vn.push_back(FVertex3D(0, 1, 0));
+            }
+        for(unsigned int y=0; y < size; y++)
+            for(unsigned int x=0; x < size; x++) {
+                unsigned int corner = y*(size+1) + x;
+                FFace face;
+                for(unsigned int v : { corner, corner + 1, corner + size + 2, corner + size + 1 })
+                    face.push_back(FFacePoint(v, 0, v));
+                mesh.f.push_back(face);
+            }
+        return mesh;
+    }
+
+    void test_feather(std::string directory, const FMesh& cube, bool update)
+    {
+        std::string golden = directory + "/cube.feather";
+        if(update) {
+            plugin::clear();
+            add_mesh_node("cube", cube);
+            check(io::feather_format::save(golden), "update cube.feather");
+        }
+
+        bool ok = io::feather_format::open(golden);
+        check(ok && scene_mesh("cube", cube), "open cube.feather");
+
+        // a lazy open leaves the mesh in the file until it's loaded
+        ok = io::feather_format::open(golden, true) && io::feather_format::pending() > 0;
+        ok = ok && io::feather_format::load() > 0 && !io::feather_format::pending();
+        check(ok && scene_mesh("cube", cube), "lazy open and load cube.feather");
+
+        // the opened scene saved again has to open the same
+        std::string filename = "io_roundtrip_cube.feather";
+        ok = io::feather_format::save(filename) && io::feather_format::open(filename);
+        check(ok && scene_mesh("cube", cube), "save and open the opened scene");
+
+        // compressed blocks with both filters
+        FMesh big = grid(400);
+        plugin::clear();
+        add_mesh_node("grid", big);
+        ok = io::feather_format::save(filename, true, io::feather_format::Shuffle|io::feather_format::Delta, 2);
+        ok = ok && io::feather_format::open(filename, true) && io::feather_format::load() > 0;
+        check(ok && scene_mesh("grid", big), "save and open a compressed scene");
+
+        plugin::clear();
+        std::remove(filename.c_str());
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if(argc < 2) {
+        std::cout << "usage: io_roundtrip <tests directory> [--update]\n";
+        return 2;
+    }
+
+    std::string directory = argv[1];
+    bool update = argc > 2 && std::string(argv[2]) == "--update";
+
+    FMesh cube;
+    check(import_obj(directory + "/cube.obj", cube) && cube.v.size() == 8 && cube.vn.size() == 8 && cube.f.size() == 6, "import cube.obj");
+
+    test_ply(directory, cube, update);
+    test_obj_export(cube);
+    test_tracks(directory, update);
+    test_cache(directory, cube, update);
+    test_mesh(directory, cube, update);
+    test_feather(directory, cube, update);
+
+    std::cout << (failures ? "io roundtrip FAILED\n" : "io roundtrip passed\n");
+    return failures ? 1 : 0;
+}
@@ -34,6 +34,7 @@
 #include <feather/plugin.hpp>
 
 #include "subdiv.hpp"
+#include <set>
 
 #ifdef __cplusplus
 extern "C" {
@@ -438,6 +439,21 @@ ADD_FIELD_TO_NODE(POLYGON_SUBDIV,FInt,field::Int,field::connection::In,2,2)
 ADD_FIELD_TO_NODE(POLYGON_SUBDIV,FVertexIndiceGroupWeightArray,field::VertexIndiceGroupWeightArray,field::connection::In,std::vector<FVertexIndiceGroupWeight>(),3)
 // edge weights
 ADD_FIELD_TO_NODE(POLYGON_SUBDIV,FVertexIndiceGroupWeightArray,field::VertexIndiceGroupWeightArray,field::connection::In,std::vector<FVertexIndiceGroupWeight>(),4)
+// evaluator
+// 0 = Serial
+// 1 = Threaded
+ADD_FIELD_TO_NODE(POLYGON_SUBDIV,FInt,field::Int,field::connection::In,0,6)
+// refinement
+// 0 = Uniform
+// 1 = Adaptive
+ADD_FIELD_TO_NODE(POLYGON_SUBDIV,FInt,field::Int,field::connection::In,0,7)
+// adaptive tessellation, quads along each side of a base face rounded up
+// to a power of two, halved for each level a patch is refined
+ADD_FIELD_TO_NODE(POLYGON_SUBDIV,FInt,field::Int,field::connection::In,4,8)
+// output
+// 0 = Rebuild
+// 1 = In place, the output mesh arrays are kept between updates
+ADD_FIELD_TO_NODE(POLYGON_SUBDIV,FInt,field::Int,field::connection::In,0,9)
 // OUT
 // mesh
 ADD_FIELD_TO_NODE(POLYGON_SUBDIV,FMesh,field::Mesh,field::connection::Out,FMesh(),5)
@@ -445,6 +461,32 @@ ADD_FIELD_TO_NODE(POLYGON_SUBDIV,FMesh,field::Mesh,field::connection::Out,FMesh(
 namespace feather
 {
 
+    // each subdiv node keeps it's own refiner so only a topology change
+    // has to rebuild it, they're found by the node's output field
+    typedef std::map<field::FieldBase*,subdiv::Refiner> SubdivRefiners;
+
+    // The plugin isn't told when a node is deleted, so the refiners of
+    // nodes that aren't in the scene anymore are dropped whenever a node
+    // is new or a refiner is rebuilt.
+    void prune_refiners(SubdivRefiners& refiners)
+    {
+        std::vector<unsigned int> uids;
+        plugin::get_nodes(uids);
+
+        std::set<field::FieldBase*> live;
+        status p;
+        for(unsigned int uid : uids)
+            if(plugin::get_node_id(uid,p) == POLYGON_SUBDIV)
+                live.insert(plugin::get_field_base(uid,POLYGON_SUBDIV,5,0));
+
+        for(auto it = refiners.begin(); it != refiners.end();) {
+            if(live.count(it->first))
+                ++it;
+            else
+                it = refiners.erase(it);
+        }
+    }
+
     DO_IT(POLYGON_SUBDIV) 
     {
         GET_FIELD_DATA(1,FMesh,meshIn,field::connection::In)
@@ -452,28 +494,46 @@ namespace feather
         GET_FIELD_DATA(3,FVertexIndiceGroupWeightArray,vertexWeightsIn,field::connection::In)
         GET_FIELD_DATA(4,FVertexIndiceGroupWeightArray,edgeWeightsIn,field::connection::In)
         GET_FIELD_DATA(5,FMesh,meshOut,field::connection::Out)
+        GET_FIELD_DATA(6,FInt,evaluatorIn,field::connection::In)
+        GET_FIELD_DATA(7,FInt,refinementIn,field::connection::In)
+        GET_FIELD_DATA(8,FInt,tessellationIn,field::connection::In)
+        GET_FIELD_DATA(9,FInt,outputIn,field::connection::In)
+
+        static SubdivRefiners refiners;
 
-        if(meshIn->update || levelIn->update || vertexWeightsIn->update || edgeWeightsIn->update)
+        if(meshIn->update || levelIn->update || vertexWeightsIn->update || edgeWeightsIn->update || evaluatorIn->update || refinementIn->update || tessellationIn->update || outputIn->update)
         {
             std::cout << "SUBDIV DO_IT() UPDATE\n";
             // if there is no input mesh, get out of here
             if(!meshIn->value.v.size())
                 return status();
 
-            // clear the mesh
-            meshOut->value.v.clear();
-            meshOut->value.st.clear();
-            meshOut->value.vn.clear();
-            meshOut->value.f.clear();
+            // A node that hasn't written it's output yet is new, it could
+            // be at the address of a deleted node so it starts with a new
+            // refiner.
+            bool fresh = meshOut->value.v.empty();
+            if(fresh) {
+                refiners.erase(meshOut);
+                prune_refiners(refiners);
+            }
 
-            subdiv::subdiv_mesh(
+            // the refiner clears the mesh unless it's writing in place
+            subdiv::Refiner& refiner = refiners[meshOut];
+            refiner.subdiv_mesh(
                     levelIn->value,
                     &meshIn->value,
                     &meshOut->value,
                     &vertexWeightsIn->value,
-                    &edgeWeightsIn->value
+                    &edgeWeightsIn->value,
+                    (evaluatorIn->value == subdiv::kThreaded) ? subdiv::kThreaded : subdiv::kSerial,
+                    (refinementIn->value == subdiv::kAdaptive) ? subdiv::kAdaptive : subdiv::kUniform,
+                    std::max(tessellationIn->value, 1),
+                    (outputIn->value == subdiv::kInPlace) ? subdiv::kInPlace : subdiv::kRebuild
                     );
 
+            if(refiner.rebuilt() && !fresh)
+                prune_refiners(refiners);
+
             meshOut->update = true;
         }
 
@@ -24,6 +24,11 @@
 // A lot of this code comes from OpenSubdiv's far_tutorial_8.cpp
 
 #include "subdiv.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+#include <tuple>
 
 using namespace feather;
 
@@ -49,6 +54,28 @@ void subdiv::Shape::loadMesh(
     nvertsPerFace = mesh->verts_per_face();
     faceverts = mesh->vert_indices_per_face();
 
+    // the texture coords go in as a face varying channel, a face point
+    // without a coord would make the refiner read past the end so the
+    // channel is skipped if any are out of range
+    if(!mesh->st.empty()) {
+        bool valid = true;
+        for(auto& f : mesh->f)
+            for(auto& fp : f)
+                if(fp.vt >= mesh->st.size())
+                    valid = false;
+
+        if(valid) {
+            for(auto st : mesh->st){
+                uvs.push_back(st.s);
+                uvs.push_back(st.t);
+            }
+
+            for(auto& f : mesh->f)
+                for(auto& fp : f)
+                    faceuvs.push_back(fp.vt);
+        }
+    }
+
     // For now we'll use Chaikin as the default smoothing method but this will be adjustable in the future
     tag *smoothmethod = new tag();
     smoothmethod->name="creasemethod";
@@ -136,21 +163,469 @@ std::string subdiv::Shape::tag::genTag() const {
 }
 
 
-void subdiv::subdiv_mesh(
+namespace
+{
+
+    // fnv-1a over 32 bit words, this runs on every update so it's kept cheap
+    inline void hash_value(uint64_t& hash, uint32_t value)
+    {
+        hash ^= value;
+        hash *= 1099511628211ULL;
+    }
+
+    void hash_weights(uint64_t& hash, FVertexIndiceGroupWeightArray* weights)
+    {
+        hash_value(hash, weights->size());
+        for(auto& group : *weights) {
+            // the shape tags use float weights
+            float weight = group.weight;
+            uint32_t bits;
+            memcpy(&bits, &weight, sizeof(bits));
+            hash_value(hash, bits);
+            hash_value(hash, group.v.size());
+            for(auto v : group.v)
+                hash_value(hash, v);
+        }
+    }
+
+    // Threads kept for the life of the plugin so each evaluation doesn't
+    // have to start new ones. run() splits [0,count) into one range for
+    // each thread, the calling thread takes the first range, and it
+    // returns when every range is done. Only one run() happens at a time.
+    class Workers
+    {
+        public:
+            Workers() : _call(nullptr), _fn(nullptr), _count(0), _generation(0), _pending(0), _stop(false) {
+                unsigned int cores = std::thread::hardware_concurrency();
+                for(unsigned int i=1; i < cores; i++)
+                    _threads.push_back(std::thread(&Workers::work, this, i));
+            };
+
+            ~Workers() {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _stop = true;
+                }
+                _start.notify_all();
+                for(auto& t : _threads)
+                    t.join();
+            };
+
+            // fn(begin,end) is called once for each range
+            template <typename Function>
+            void run(int count, Function& fn) { run(count, &call<Function>, &fn); };
+
+        private:
+            template <typename Function>
+            static void call(void* fn, int begin, int end) { (*static_cast<Function*>(fn))(begin, end); };
+
+            void range(unsigned int index, int& begin, int& end) const {
+                int64_t size = _threads.size() + 1;
+                begin = int(_count * index / size);
+                end = int(_count * (index+1) / size);
+            };
+
+            void run(int count, void (*fn_call)(void*,int,int), void* fn) {
+                std::lock_guard<std::mutex> running(_running);
+
+                // not worth waking the threads for
+                if(count < int(_threads.size()+1) * 256) {
+                    fn_call(fn, 0, count);
+                    return;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _call = fn_call;
+                    _fn = fn;
+                    _count = count;
+                    _pending = _threads.size();
+                    _generation++;
+                }
+                _start.notify_all();
+
+                int begin, end;
+                range(0, begin, end);
+                fn_call(fn, begin, end);
+
+                std::unique_lock<std::mutex> lock(_mutex);
+                _done.wait(lock, [this] () { return _pending == 0; });
+            };
+
+            void work(unsigned int index) {
+                uint64_t generation = 0;
+                for(;;) {
+                    void (*fn_call)(void*,int,int);
+                    void* fn;
+                    int begin, end;
+                    {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        _start.wait(lock, [&] () { return _stop || _generation != generation; });
+                        if(_stop)
+                            return;
+                        generation = _generation;
+                        fn_call = _call;
+                        fn = _fn;
+                        range(index, begin, end);
+                    }
+
+                    fn_call(fn, begin, end);
+
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if(--_pending == 0)
+                        _done.notify_one();
+                }
+            };
+
+            std::vector<std::thread> _threads;
+            void (*_call)(void*,int,int);
+            void* _fn;
+            int64_t _count;
+            uint64_t _generation;
+            unsigned int _pending;
+            bool _stop;
+            std::mutex _running;
+            std::mutex _mutex;
+            std::condition_variable _start;
+            std::condition_variable _done;
+    };
+
+    // the threads are started the first time they're needed
+    Workers& workers()
+    {
+        static Workers pool;
+        return pool;
+    }
+
+
+    // The tangent stencils are made by running PrimvarRefiner::Limit() on
+    // indices instead of vertices, each weight it would have added to a
+    // derivative is kept along with the index of the vertex it's for.
+    struct StencilIndex {
+        int index;
+    };
+
+    struct StencilSource {
+        StencilIndex operator[](int index) const { return StencilIndex{index}; };
+    };
+
+    // the limit positions aren't needed
+    struct StencilSkip {
+        void Clear() { };
+        void AddWithWeight(StencilIndex const &, float) { };
+    };
+
+    struct StencilSkipArray {
+        StencilSkip & operator[](int) { return skip; };
+        StencilSkip skip;
+    };
+
+    struct TangentEntry {
+        int index;
+        float du;
+        float dv;
+    };
+
+    // du or dv of one vertex, both add to the same entries so the two
+    // derivatives share their indices
+    struct TangentBuilder {
+        // the entries start out empty and are shared by du and dv
+        void Clear() { };
+
+        void AddWithWeight(StencilIndex const & src, float weight) {
+            for(auto& e : *entries) {
+                if(e.index == src.index) {
+                    (dv ? e.dv : e.du) += weight;
+                    return;
+                }
+            }
+            entries->push_back(TangentEntry{src.index, dv ? 0.0f : weight, dv ? weight : 0.0f});
+        };
+
+        std::vector<TangentEntry> *entries;
+        bool dv;
+    };
+
+
+    // dst[i] is made from src with stencil i, for i in [begin,end)
+    void apply_stencils(
+            OpenSubdiv::Far::StencilTable const & table,
+            subdiv::Vertex const * src,
+            subdiv::Vertex * dst,
+            int begin,
+            int end
+            )
+    {
+        if(begin >= end)
+            return;
+
+        int const * sizes = &table.GetSizes()[0];
+        OpenSubdiv::Far::Index const * offsets = &table.GetOffsets()[0];
+        OpenSubdiv::Far::Index const * indices = &table.GetControlIndices()[0];
+        float const * weights = &table.GetWeights()[0];
+
+        for (int i = begin; i < end; ++i) {
+            dst[i].Clear();
+            int offset = offsets[i];
+            for (int j = 0; j < sizes[i]; ++j)
+                dst[i].AddWithWeight(src[indices[offset+j]], weights[offset+j]);
+        }
+    }
+
+    // normals[i] is made from the limit derivatives of stencil i, dst[i]
+    // gets the limit position if the stencils have position weights
+    template <typename Stencils>
+    void apply_limit(
+            Stencils const & stencils,
+            subdiv::Vertex const * src,
+            subdiv::Vertex * dst,
+            subdiv::Vertex * normals,
+            int begin,
+            int end
+            )
+    {
+        bool position = !stencils.weights.empty();
+
+        for (int i = begin; i < end; ++i) {
+            float p[3] = {0.0f, 0.0f, 0.0f};
+            float du[3] = {0.0f, 0.0f, 0.0f};
+            float dv[3] = {0.0f, 0.0f, 0.0f};
+
+            int offset = stencils.offsets[i];
+            for (int j = 0; j < stencils.sizes[i]; ++j) {
+                float const * pos = src[stencils.indices[offset+j]].GetPosition();
+                float w = position ? stencils.weights[offset+j] : 0.0f;
+                float wu = stencils.duWeights[offset+j];
+                float wv = stencils.dvWeights[offset+j];
+                for (int c = 0; c < 3; ++c) {
+                    p[c] += w * pos[c];
+                    du[c] += wu * pos[c];
+                    dv[c] += wv * pos[c];
+                }
+            }
+
+            if(position)
+                dst[i].SetPosition(p[0], p[1], p[2]);
+
+            float norm[3];
+            subdiv::cross(du, dv, norm);
+            subdiv::normalize(norm);
+            normals[i].SetPosition(norm[0], norm[1], norm[2]);
+        }
+    }
+
+    // splits fn over the workers or runs it all on this thread
+    template <typename Function>
+    void run(bool threaded, int count, Function & fn)
+    {
+        if(threaded)
+            workers().run(count, fn);
+        else
+            fn(0, count);
+    }
+
+    // Names a tessellated point by where it is on the base mesh so every
+    // patch that has it finds the same vertex. Points on a base vertex or
+    // edge, or on a spoke of a split non-quad face, are named by that
+    // element so it doesn't matter which face they came from, the rest by
+    // their ptex face. The parameters are reduced fractions so they match
+    // exactly.
+    enum PointKind { kBaseVertex, kBaseEdge, kSpoke, kCenter, kInside };
+
+    struct PointKey {
+        int kind;
+        int element;
+        long long num[2];
+        long long den[2];
+
+        bool operator < (PointKey const & other) const {
+            return std::tie(kind, element, num[0], den[0], num[1], den[1])
+                < std::tie(other.kind, other.element, other.num[0], other.den[0], other.num[1], other.den[1]);
+        }
+    };
+
+    // the base face of a ptex face, quads have one ptex face and the
+    // other faces are split into one for each corner
+    struct PtexFace {
+        int face;
+        int corner;
+    };
+
+    void reduce(long long & num, long long & den)
+    {
+        long long a = num, b = den;
+        while (b) {
+            long long r = a % b;
+            a = b;
+            b = r;
+        }
+        if (a) {
+            num /= a;
+            den /= a;
+        }
+    }
+
+    PointKey make_key(int kind, int element, long long num0=0, long long den0=1, long long num1=0, long long den1=1)
+    {
+        reduce(num0, den0);
+        reduce(num1, den1);
+        PointKey key = { kind, element, { num0, num1 }, { den0, den1 } };
+        return key;
+    }
+
+    // the point t/den along a base edge measured from the vertex from
+    PointKey edge_key(OpenSubdiv::Far::TopologyLevel const & base, int edge, int from, long long t, long long den)
+    {
+        OpenSubdiv::Far::ConstIndexArray everts = base.GetEdgeVertices(edge);
+        if (everts[0] != from)
+            t = den - t;
+        if (t == 0)
+            return make_key(kBaseVertex, everts[0]);
+        if (t == den)
+            return make_key(kBaseVertex, everts[1]);
+        return make_key(kBaseEdge, edge, t, den);
+    }
+
+    // The point (u/den, v/den) of a ptex face. The ptex edges go round the
+    // face from (0,0) to (1,0), (1,1) and (0,1), a quad's line up with it's
+    // edges. The quad at corner j of a non-quad face starts at vertex j
+    // with u going to the middle of edge j and v to the middle of edge j-1,
+    // it's other two sides are the spokes to the middle of the face.
+    PointKey point_key(
+            OpenSubdiv::Far::TopologyLevel const & base,
+            PtexFace const & ptex,
+            int ptexIndex,
+            long long u,
+            long long v,
+            long long den
+            )
+    {
+        if (u > 0 && u < den && v > 0 && v < den)
+            return make_key(kInside, ptexIndex, u, den, v, den);
+
+        int side;
+        long long s;
+        if (v == 0) {
+            side = 0;
+            s = u;
+        } else if (u == den) {
+            side = 1;
+            s = v;
+        } else if (v == den) {
+            side = 2;
+            s = den - u;
+        } else {
+            side = 3;
+            s = den - v;
+        }
+
+        OpenSubdiv::Far::ConstIndexArray fverts = base.GetFaceVertices(ptex.face);
+        OpenSubdiv::Far::ConstIndexArray fedges = base.GetFaceEdges(ptex.face);
+
+        if (ptex.corner < 0)
+            return edge_key(base, fedges[side], fverts[side], s, den);
+
+        int j = ptex.corner;
+        int prev = (j + fverts.size() - 1) % fverts.size();
+        if (side == 0)
+            return edge_key(base, fedges[j], fverts[j], s, 2*den);
+        if (side == 3)
+            return edge_key(base, fedges[prev], fverts[prev], den + s, 2*den);
+
+        // the spokes go from the middle of the edge to the middle of the face
+        int spoke = (side == 1) ? j : prev;
+        long long t = (side == 1) ? s : den - s;
+        if (t == 0)
+            return edge_key(base, fedges[spoke], fverts[spoke], 1, 2);
+        if (t == den)
+            return make_key(kCenter, ptex.face);
+        return make_key(kSpoke, ptex.face, spoke, 1, t, den);
+    }
+
+} // namespace
+
+
+uint64_t subdiv::topology_hash(
+        unsigned int maxlevel,
+        feather::FMesh *mesh,
+        feather::FVertexIndiceGroupWeightArray *vertexWeights,
+        feather::FVertexIndiceGroupWeightArray *edgeWeights
+        )
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    hash_value(hash, maxlevel);
+    hash_value(hash, mesh->v.size());
+    hash_value(hash, mesh->st.size());
+    hash_value(hash, mesh->f.size());
+
+    for(auto& f : mesh->f) {
+        hash_value(hash, f.size());
+        for(auto& fp : f) {
+            hash_value(hash, fp.v);
+            hash_value(hash, fp.vt);
+        }
+    }
+
+    hash_weights(hash, vertexWeights);
+    hash_weights(hash, edgeWeights);
+
+    return hash;
+}
+
+
+subdiv::Refiner::Refiner() :
+    _hash(0),
+    _vertexCount(0),
+    _faceCount(0),
+    _level(0),
+    _refinement(kUniform),
+    _tessellation(4),
+    _rebuilt(false),
+    _refiner(nullptr),
+    _stencils(nullptr),
+    _hasTangents(false)
+{
+}
+
+subdiv::Refiner::~Refiner()
+{
+    clear();
+}
+
+void subdiv::Refiner::clear()
+{
+    delete _stencils;
+    _stencils = nullptr;
+    delete _refiner;
+    _refiner = nullptr;
+    _tangents = LimitStencils();
+    _hasTangents = false;
+    _patchStencils = LimitStencils();
+    _patchFaces.clear();
+    _patchFaceUVs.clear();
+    _patchFaceOffsets.clear();
+    _patchUVIndices.clear();
+    _patchUVWeights.clear();
+    _uvs.clear();
+    _patchUVs.clear();
+}
+
+void subdiv::Refiner::build(
         unsigned int maxlevel,
         feather::FMesh *meshIn,
-        feather::FMesh *meshOut,
         feather::FVertexIndiceGroupWeightArray *vertexWeights,
         feather::FVertexIndiceGroupWeightArray *edgeWeights
         )
 {
-    Shape *shape = new Shape();
+    clear();
 
-    shape->loadMesh(meshIn,vertexWeights,edgeWeights);
+    Shape shape;
+    shape.loadMesh(meshIn,vertexWeights,edgeWeights);
 
     // create Far mesh (topology)
-    OpenSubdiv::Sdc::SchemeType sdctype = GetSdcType(*shape);
-    OpenSubdiv::Sdc::Options sdcoptions = GetSdcOptions(*shape);
+    OpenSubdiv::Sdc::SchemeType sdctype = GetSdcType(shape);
+    OpenSubdiv::Sdc::Options sdcoptions = GetSdcOptions(shape);
 
     typedef OpenSubdiv::Sdc::Options SdcOptions;
 
@@ -159,187 +634,543 @@ void subdiv::subdiv_mesh(
     sdcoptions.SetFVarLinearInterpolation(g_fvarInterpolation);
 
     // Instantiate a FarTopologyRefiner from the descriptor
-    OpenSubdiv::Far::TopologyRefiner * refiner = OpenSubdiv::Far::TopologyRefinerFactory<Shape>::Create(*shape, OpenSubdiv::Far::TopologyRefinerFactory<Shape>::Options(sdctype, sdcoptions));
+    _refiner = OpenSubdiv::Far::TopologyRefinerFactory<Shape>::Create(shape, OpenSubdiv::Far::TopologyRefinerFactory<Shape>::Options(sdctype, sdcoptions));
 
-    bool g_Adaptive = false;
+    // bad crease or corner tags, nothing is output until the topology changes
+    if(!_refiner) {
+        std::cout << "subdiv: could not create the topology refiner\n";
+        return;
+    }
 
-    if (g_Adaptive) {
+    _level = maxlevel;
+
+    OpenSubdiv::Far::StencilTableFactory::Options stencilOptions;
+    stencilOptions.generateOffsets = true;
+
+    if (_refinement == kAdaptive) {
         OpenSubdiv::Far::TopologyRefiner::AdaptiveOptions options(maxlevel);
         options.useSingleCreasePatch = false;
-        refiner->RefineAdaptive(options);
+        _refiner->RefineAdaptive(options);
+
+        // the patches use vertices from every level
+        stencilOptions.generateIntermediateLevels = true;
+        stencilOptions.generateControlVerts = false;
+        _stencils = OpenSubdiv::Far::StencilTableFactory::Create(*_refiner, stencilOptions);
+
+        OpenSubdiv::Far::PatchTableFactory::Options patchOptions;
+        patchOptions.SetEndCapType(OpenSubdiv::Far::PatchTableFactory::Options::ENDCAP_GREGORY_BASIS);
+        patchOptions.generateFVarTables = shape.HasUV();
+
+        OpenSubdiv::Far::PatchTable const * patches = OpenSubdiv::Far::PatchTableFactory::Create(*_refiner, patchOptions);
+
+        // the end caps around extraordinary vertices have points of their
+        // own, their stencils go after the refined vertices
+        OpenSubdiv::Far::StencilTable const * local = patches->GetLocalPointStencilTable();
+        if (local) {
+            OpenSubdiv::Far::StencilTable const * combined = OpenSubdiv::Far::StencilTableFactory::AppendLocalPointStencilTable(*_refiner, _stencils, local);
+            if (combined) {
+                delete _stencils;
+                _stencils = combined;
+            }
+        }
+
+        // only the tessellation stencils are kept
+        build_patches(*patches);
+        delete patches;
     } else {
         OpenSubdiv::Far::TopologyRefiner::UniformOptions options(maxlevel);
         options.fullTopologyInLastLevel = true;
-        refiner->RefineUniform(options);
+        _refiner->RefineUniform(options);
+
+        // Only the last level is needed so the stencils go straight from the
+        // coarse vertices to it. Level 0 has no refined vertices so the control
+        // vertices are used instead.
+        stencilOptions.generateIntermediateLevels = false;
+        stencilOptions.generateControlVerts = (maxlevel == 0);
+        _stencils = OpenSubdiv::Far::StencilTableFactory::Create(*_refiner, stencilOptions);
+    }
+}
+
+void subdiv::Refiner::build_patches(OpenSubdiv::Far::PatchTable const & patches)
+{
+    OpenSubdiv::Far::TopologyLevel const & base = _refiner->GetLevel(0);
+
+    OpenSubdiv::Far::PtexIndices ptexIndices(*_refiner);
+    std::vector<PtexFace> ptexFaces(ptexIndices.GetNumFaces());
+    for (int face = 0; face < base.GetNumFaces(); ++face) {
+        int first = ptexIndices.GetFaceId(face);
+        int size = base.GetFaceVertices(face).size();
+        if (size == 4) {
+            ptexFaces[first] = PtexFace{face, -1};
+            continue;
+        }
+        for (int corner = 0; corner < size; ++corner)
+            ptexFaces[first + corner] = PtexFace{face, corner};
     }
 
-    // Allocate a buffer for vertex primvar data. The buffer length is set to
-    // be the sum of all children vertices up to the highest level of refinement.
-    std::vector<subdiv::Vertex> vbuffer(refiner->GetNumVerticesTotal());
-    subdiv::Vertex *verts = &vbuffer[0];
+    // Each base face gets the tessellation along it's sides rounded up to
+    // a power of two, a patch a level down covers half as much so it gets
+    // half as many. Neighbours a level apart then put their vertices in
+    // the same places along the edge between them.
+    int rate = 1;
+    while (rate < int(_tessellation) && rate < (1 << 16))
+        rate *= 2;
+
+    bool hasUV = _refiner->GetNumFVarChannels() > 0;
+
+    std::map<PointKey,int> points;
+    // the coords are linear over each ptex face but not across them
+    std::map<std::pair<int,int>,int> coords;
+    std::vector<int> grid;
+    std::vector<int> gridUVs;
+
+    _patchFaceOffsets.push_back(0);
+
+    // the handles are made the same way Far::PatchMap makes them
+    int current = 0;
+    for (int array = 0; array < patches.GetNumPatchArrays(); ++array) {
+        int ncvs = patches.GetPatchArrayDescriptor(array).GetNumControlVertices();
+
+        for (int patch = 0; patch < patches.GetNumPatches(array); ++patch, ++current) {
+            OpenSubdiv::Far::PatchTable::PatchHandle handle;
+            handle.arrayIndex = array;
+            handle.patchIndex = current;
+            handle.vertIndex = patch * ncvs;
+
+            OpenSubdiv::Far::ConstIndexArray cvs = patches.GetPatchVertices(handle);
+            OpenSubdiv::Far::PatchParam param = patches.GetPatchParam(handle);
+
+            OpenSubdiv::Far::ConstIndexArray fvars;
+            if (hasUV)
+                fvars = patches.GetPatchFVarValues(handle, 0);
+
+            int n = std::max(rate >> param.GetDepth(), 1);
+
+            // A patch down to one quad can't halve for a deeper neighbour,
+            // it's a single face with the middles of those edges added.
+            int transition = (n == 1) ? param.GetTransition() : 0;
+            int size = transition ? 2 : n;
+
+            // where the grid is on it's ptex face, non-quad faces were
+            // split once before the first level
+            int ptex = param.GetFaceId();
+            int shift = param.GetDepth() - (param.NonQuadRoot() ? 1 : 0);
+            long long den = (long long)size << shift;
+            long long u0 = (long long)param.GetU() * size;
+            long long v0 = (long long)param.GetV() * size;
+
+            grid.assign((size+1) * (size+1), -1);
+            gridUVs.assign(grid.size(), -1);
+
+            // the vertex at (x,y) on the grid, the border ones could have
+            // been made by a neighbour already
+            auto vertex = [&] (int x, int y) {
+                int cell = y*(size+1) + x;
+                if (grid[cell] >= 0)
+                    return cell;
+
+                // the basis is evaluated in face coordinates so the
+                // grid on the patch is moved out to it's face
+                float s = float(x) / size;
+                float t = float(y) / size;
+
+                bool border = (x == 0 || y == 0 || x == size || y == size);
+                std::map<PointKey,int>::iterator found = points.end();
+                if (border) {
+                    PointKey key = point_key(base, ptexFaces[ptex], ptex, u0 + x, v0 + y, den);
+                    found = points.insert(std::make_pair(key, int(_patchStencils.sizes.size()))).first;
+                }
+
+                if (!border || found->second == int(_patchStencils.sizes.size())) {
+                    float u = s;
+                    float v = t;
+                    param.Unnormalize(u, v);
+
+                    float wP[20], wDs[20], wDt[20];
+                    patches.EvaluateBasis(handle, u, v, wP, wDs, wDt);
+
+                    _patchStencils.sizes.push_back(cvs.size());
+                    _patchStencils.offsets.push_back(_patchStencils.indices.size());
+                    for (int i = 0; i < cvs.size(); ++i) {
+                        _patchStencils.indices.push_back(cvs[i]);
+                        _patchStencils.weights.push_back(wP[i]);
+                        _patchStencils.duWeights.push_back(wDs[i]);
+                        _patchStencils.dvWeights.push_back(wDt[i]);
+                    }
+                }
+                grid[cell] = border ? found->second : int(_patchStencils.sizes.size()) - 1;
+
+                if (hasUV) {
+                    int uv = _patchUVIndices.size() / 4;
+                    if (border)
+                        uv = coords.insert(std::make_pair(std::make_pair(grid[cell], ptex), uv)).first->second;
+
+                    if (uv == int(_patchUVIndices.size() / 4)) {
+                        float w[4] = { (1-s)*(1-t), s*(1-t), s*t, (1-s)*t };
+                        for (int i = 0; i < 4; ++i) {
+                            _patchUVIndices.push_back(fvars[i < fvars.size() ? i : 0]);
+                            _patchUVWeights.push_back(i < fvars.size() ? w[i] : 0.0f);
+                        }
+                    }
+                    gridUVs[cell] = uv;
+                }
+                return cell;
+            };
+
+            auto corner = [&] (int x, int y) {
+                int cell = vertex(x, y);
+                _patchFaces.push_back(grid[cell]);
+                if (hasUV)
+                    _patchFaceUVs.push_back(gridUVs[cell]);
+            };
+
+            if (transition) {
+                // round the patch, the middles are only on the transition edges
+                static const int ring[8][3] = {
+                    {0,0,-1}, {1,0,0}, {2,0,-1}, {2,1,1}, {2,2,-1}, {1,2,2}, {0,2,-1}, {0,1,3}
+                };
+                for (int i = 0; i < 8; ++i)
+                    if (ring[i][2] < 0 || (transition & (1 << ring[i][2])))
+                        corner(ring[i][0], ring[i][1]);
+                _patchFaceOffsets.push_back(_patchFaces.size());
+                continue;
+            }
 
-    // Initialize coarse mesh positions
-    int nCoarseVerts = meshIn->v.size();
-    for (int i=0; i<nCoarseVerts; ++i) {
-        verts[i].SetPosition(meshIn->v[i].x, meshIn->v[i].y, meshIn->v[i].z);
-        //verts[i].SetPosition(g_verts[i][0], g_verts[i][1], g_verts[i][2]);
+            for (int y = 0; y < size; ++y) {
+                for (int x = 0; x < size; ++x) {
+                    corner(x, y);
+                    corner(x + 1, y);
+                    corner(x + 1, y + 1);
+                    corner(x, y + 1);
+                    _patchFaceOffsets.push_back(_patchFaces.size());
+                }
+            }
+        }
     }
+}
 
-    // Interpolate vertex primvar data
-    OpenSubdiv::Far::PrimvarRefiner primvarRefiner(*refiner);
+void subdiv::Refiner::build_tangents()
+{
+    int nverts = _refiner->GetLevel(_level).GetNumVertices();
 
-    subdiv::Vertex *src = verts;
-    for (int level = 1; level <= maxlevel; ++level) {
-        subdiv::Vertex *dst = src + refiner->GetLevel(level-1).GetNumVertices();
-        primvarRefiner.Interpolate(level, src, dst);
-        src = dst;
+    std::vector<std::vector<TangentEntry>> entries(nverts);
+    std::vector<TangentBuilder> du(nverts);
+    std::vector<TangentBuilder> dv(nverts);
+    for (int vert = 0; vert < nverts; ++vert) {
+        du[vert] = TangentBuilder{&entries[vert], false};
+        dv[vert] = TangentBuilder{&entries[vert], true};
     }
 
-    // Approximate normals
-    OpenSubdiv::Far::TopologyLevel const & refLastLevel = refiner->GetLevel(maxlevel);
-    int nverts = refLastLevel.GetNumVertices();
-    int nfaces = refLastLevel.GetNumFaces();
-    int firstOfLastVerts = refiner->GetNumVerticesTotal() - nverts;
-
-    std::vector<Vertex> normals(nverts);
-    
-    // CrossTriangle produces random normals for some reason, don't use
-    //enum subdiv::NormalApproximation normalApproximation = subdiv::CrossTriangle;
-    // Limit works, haven't CrossQuad yet 
-    enum subdiv::NormalApproximation normalApproximation = subdiv::Limit;
-
-
-    // Different ways to approximate smooth normals
-    //
-    // For details check the description at the beginning of the file
-    if (normalApproximation == subdiv::Limit) {
-
-        // Approximation using the normal at the limit with verts that are 
-        // not at the limit
-        //
-        // For details check the description at the beginning of the file
-
-        std::vector<Vertex> fineLimitPos(nverts);
-        std::vector<Vertex> fineDu(nverts);
-        std::vector<Vertex> fineDv(nverts);
-
-        primvarRefiner.Limit(&verts[firstOfLastVerts], fineLimitPos, fineDu, fineDv);
-        
-        for (int vert = 0; vert < nverts; ++vert) {
-            float const * du = fineDu[vert].GetPosition();
-            float const * dv = fineDv[vert].GetPosition();
-            
-            float norm[3];
-            subdiv::cross(du, dv, norm);
-            normals[vert].SetPosition(norm[0], norm[1], norm[2]);
-        }
+    StencilSkipArray skip;
+    OpenSubdiv::Far::PrimvarRefiner primvarRefiner(*_refiner);
+    primvarRefiner.Limit(StencilSource(), skip, du, dv);
 
-    } else if (normalApproximation == subdiv::CrossQuad) {
-
-        // Approximate smooth normals by accumulating normal vectors computed as
-        // the cross product of two vectors generated by the 4 verts that 
-        // form each quad
-        //
-        // For details check the description at the beginning of the file
-
-        for (int f = 0; f < nfaces; f++) {
-            OpenSubdiv::Far::ConstIndexArray faceVertices = refLastLevel.GetFaceVertices(f);
-
-            // We will use the first three verts to calculate a normal
-            const float * v0 = verts[ firstOfLastVerts + faceVertices[0] ].GetPosition();
-            const float * v1 = verts[ firstOfLastVerts + faceVertices[1] ].GetPosition();
-            const float * v2 = verts[ firstOfLastVerts + faceVertices[2] ].GetPosition();
-            const float * v3 = verts[ firstOfLastVerts + faceVertices[3] ].GetPosition();
-
-            // Calculate the cross product between the vectors formed by v1-v0 and
-            // v2-v0, and then normalize the result
-            float normalCalculated [] = {0.0,0.0,0.0};
-            float a[3] = { v2[0]-v0[0], v2[1]-v0[1], v2[2]-v0[2] };
-            float b[3] = { v3[0]-v1[0], v3[1]-v1[1], v3[2]-v1[2] };          
-            subdiv::cross(a, b, normalCalculated);
-            subdiv::normalize(normalCalculated);
-
-            // Accumulate that normal on all verts that are part of that face
-            for(int vInFace = 0; vInFace < faceVertices.size() ; vInFace++ ) {
-
-                int vertexIndex = faceVertices[vInFace];
-                normals[vertexIndex]._position[0] += normalCalculated[0];
-                normals[vertexIndex]._position[1] += normalCalculated[1];
-                normals[vertexIndex]._position[2] += normalCalculated[2];
-            }
+    size_t size = 0;
+    for (auto& e : entries)
+        size += e.size();
+
+    _tangents.sizes.resize(nverts);
+    _tangents.offsets.resize(nverts);
+    _tangents.indices.resize(size);
+    _tangents.duWeights.resize(size);
+    _tangents.dvWeights.resize(size);
+
+    int offset = 0;
+    for (int vert = 0; vert < nverts; ++vert) {
+        _tangents.sizes[vert] = entries[vert].size();
+        _tangents.offsets[vert] = offset;
+        for (auto& e : entries[vert]) {
+            _tangents.indices[offset] = e.index;
+            _tangents.duWeights[offset] = e.du;
+            _tangents.dvWeights[offset] = e.dv;
+            offset++;
         }
+    }
 
-    } else if (normalApproximation == subdiv::CrossTriangle) {
+    _hasTangents = true;
+}
 
-        // Approximate smooth normals by accumulating normal vectors computed as
-        // the cross product of two vectors generated by 3 verts of the quad
-        //
-        // For details check the description at the beginning of the file
+void subdiv::Refiner::interpolate_uvs(feather::FMesh *meshIn)
+{
+    int nCoarseUVs = meshIn->st.size();
 
-        for (int f = 0; f < nfaces; f++) {
-            OpenSubdiv::Far::ConstIndexArray faceVertices = refLastLevel.GetFaceVertices(f);
+    _uvs.resize(_refiner->GetNumFVarValuesTotal(0));
+    for (int i = 0; i < nCoarseUVs; ++i) {
+        _uvs[i].SetUV(meshIn->st[i].s, meshIn->st[i].t);
+    }
 
-            // We will use the first three verts to calculate a normal
-            const float * v0 = verts[ firstOfLastVerts + faceVertices[0] ].GetPosition();
-            const float * v1 = verts[ firstOfLastVerts + faceVertices[1] ].GetPosition();
-            const float * v2 = verts[ firstOfLastVerts + faceVertices[2] ].GetPosition();
+    OpenSubdiv::Far::PrimvarRefiner primvarRefiner(*_refiner);
 
-            // Calculate the cross product between the vectors formed by v1-v0 and
-            // v2-v0, and then normalize the result
-            float normalCalculated [] = {0.0,0.0,0.0};
-            float a[3] = { v1[0]-v0[0], v1[1]-v0[1], v1[2]-v0[2] };
-            float b[3] = { v2[0]-v0[0], v2[1]-v0[1], v2[2]-v0[2] };
-            subdiv::cross(a, b, normalCalculated);
-            subdiv::normalize(normalCalculated);
+    VertexUV *src = _uvs.data();
+    for (int level = 1; level <= _refiner->GetMaxLevel(); ++level) {
+        VertexUV *dst = src + _refiner->GetLevel(level-1).GetNumFVarValues(0);
+        primvarRefiner.InterpolateFaceVarying(level, src, dst, 0);
+        src = dst;
+    }
 
-            // Accumulate that normal on all verts that are part of that face
-            for(int vInFace = 0; vInFace < faceVertices.size() ; vInFace++ ) {
+    if (_refinement != kAdaptive)
+        return;
 
-                int vertexIndex = faceVertices[vInFace];
-                normals[vertexIndex]._position[0] += normalCalculated[0];
-                normals[vertexIndex]._position[1] += normalCalculated[1];
-                normals[vertexIndex]._position[2] += normalCalculated[2];
-            }
-        }
+    int npoints = _patchUVIndices.size() / 4;
+    _patchUVs.resize(npoints);
+    for (int i = 0; i < npoints; ++i) {
+        _patchUVs[i].Clear();
+        for (int j = i*4; j < i*4 + 4; ++j)
+            _patchUVs[i].AddWithWeight(_uvs[_patchUVIndices[j]], _patchUVWeights[j]);
     }
+}
 
-    // Finally we just need to normalize the accumulated normals
-    for (int vert = 0; vert < nverts; ++vert) {
-        subdiv::normalize(&normals[vert]._position[0]);
+void subdiv::Refiner::evaluate_serial()
+{
+    int nverts = _fine.size();
+
+    if (_refinement == kAdaptive) {
+        int nCoarseVerts = _refiner->GetLevel(0).GetNumVertices();
+        _stencils->UpdateValues(_refined.data(), _refined.data() + nCoarseVerts);
+        apply_limit(_patchStencils, _refined.data(), _fine.data(), _normals.data(), 0, nverts);
+        return;
     }
- 
-    // add vertex's
+
+    // Push the coarse positions to the last level with the stencils
+    _stencils->UpdateValues(&_coarse[0], &_fine[0]);
+
+    // Approximation using the normal at the limit with verts that are 
+    // not at the limit
+    OpenSubdiv::Far::PrimvarRefiner primvarRefiner(*_refiner);
+
+    _limit.resize(nverts);
+    _du.resize(nverts);
+    _dv.resize(nverts);
+
+    primvarRefiner.Limit(&_fine[0], _limit, _du, _dv);
+
     for (int vert = 0; vert < nverts; ++vert) {
-        float const * pos = verts[firstOfLastVerts + vert].GetPosition();
-        meshOut->v.push_back(FVertex3D(pos[0],pos[1],pos[2]));
+        float norm[3];
+        subdiv::cross(_du[vert].GetPosition(), _dv[vert].GetPosition(), norm);
+        subdiv::normalize(norm);
+        _normals[vert].SetPosition(norm[0], norm[1], norm[2]);
     }
+}
 
-    // add normals
-    //std::cout << "subdiv: number of verts:" << nverts << " number of normals:" << normals.size() << std::endl;
-    for (int vert = 0; vert < nverts; ++vert) {
-        float const * pos = normals[vert].GetPosition();
-        meshOut->vn.push_back(FVertex3D(pos[0],pos[1],pos[2]));
-        //printf("vn %f %f %f\n", pos[0], pos[1], pos[2]);
+void subdiv::Refiner::evaluate_threaded()
+{
+    int nverts = _fine.size();
+
+    // the stencils only read the coarse vertices so they can be split up,
+    // they have to be done before the limit stencils can use them
+    if (_refinement == kAdaptive) {
+        int nCoarseVerts = _refiner->GetLevel(0).GetNumVertices();
+        auto refined = [&] (int begin, int end) {
+            apply_stencils(*_stencils, _refined.data(), _refined.data() + nCoarseVerts, begin, end);
+        };
+        workers().run(_stencils->GetNumStencils(), refined);
+
+        auto limit = [&] (int begin, int end) {
+            apply_limit(_patchStencils, _refined.data(), _fine.data(), _normals.data(), begin, end);
+        };
+        workers().run(nverts, limit);
+        return;
     }
 
-    // add faces
-    for (int face = 0; face < nfaces; ++face) {
-        OpenSubdiv::Far::ConstIndexArray fverts = refLastLevel.GetFaceVertices(face);
+    if (!_hasTangents)
+        build_tangents();
+
+    auto positions = [&] (int begin, int end) {
+        apply_stencils(*_stencils, _coarse.data(), _fine.data(), begin, end);
+    };
+    workers().run(nverts, positions);
 
-        // all refined Catmark faces should be quads
-        assert(fverts.size()==4);
+    auto normals = [&] (int begin, int end) {
+        apply_limit(_tangents, _fine.data(), nullptr, _normals.data(), begin, end);
+    };
+    workers().run(nverts, normals);
+}
+
+void subdiv::Refiner::subdiv_mesh(
+        unsigned int maxlevel,
+        feather::FMesh *meshIn,
+        feather::FMesh *meshOut,
+        feather::FVertexIndiceGroupWeightArray *vertexWeights,
+        feather::FVertexIndiceGroupWeightArray *edgeWeights,
+        Evaluator evaluator,
+        Refinement refinement,
+        unsigned int tessellation,
+        Output output
+        )
+{
+    tessellation = std::max(tessellation, 1u);
+
+    // the adaptive output depends on the tessellation as well
+    uint64_t hash = topology_hash(maxlevel,meshIn,vertexWeights,edgeWeights);
+    hash_value(hash, refinement);
+    hash_value(hash, (refinement == kAdaptive) ? tessellation : 0);
+
+    _rebuilt = (hash != _hash
+            || meshIn->v.size() != _vertexCount
+            || meshIn->f.size() != _faceCount
+            || (_refiner && _refiner->GetLevel(0).GetNumVertices() != int(meshIn->v.size())));
+    if(_rebuilt) {
+        _refinement = refinement;
+        _tessellation = tessellation;
+        build(maxlevel,meshIn,vertexWeights,edgeWeights);
+        _hash = hash;
+        _vertexCount = meshIn->v.size();
+        _faceCount = meshIn->f.size();
+    }
+
+    int nCoarseVerts = meshIn->v.size();
+    if(!_refiner || !_stencils || !nCoarseVerts) {
+        meshOut->v.clear();
+        meshOut->st.clear();
+        meshOut->vn.clear();
+        meshOut->f.clear();
+        return;
+    }
+
+    // Initialize coarse mesh positions, the adaptive stencils put the
+    // refined vertices right after them
+    std::vector<Vertex> & coarse = (_refinement == kAdaptive) ? _refined : _coarse;
+    if (_refinement == kAdaptive)
+        _refined.resize(nCoarseVerts + _stencils->GetNumStencils());
+    else
+        _coarse.resize(nCoarseVerts);
+
+    for (int i=0; i<nCoarseVerts; ++i) {
+        coarse[i].SetPosition(meshIn->v[i].x, meshIn->v[i].y, meshIn->v[i].z);
+    }
 
-        FFace _face;
-        for (int vert=0; vert<fverts.size(); ++vert) {
-            _face.push_back(FFacePoint(fverts[vert],0,fverts[vert]));
+    // adaptive refinement stops early when nothing needs isolating so the
+    // level is only looked at for uniform refinement
+    int nverts = (_refinement == kAdaptive) ? int(_patchStencils.sizes.size()) : _refiner->GetLevel(_level).GetNumVertices();
+
+    _fine.resize(nverts);
+    _normals.resize(nverts);
+
+    if(evaluator == kThreaded)
+        evaluate_threaded();
+    else
+        evaluate_serial();
+
+    // the coords are usually the same every update so they're only pushed
+    // through the refiner when they change
+    bool uvChanged = false;
+    if (_refiner->GetNumFVarChannels() > 0) {
+        uvChanged = _rebuilt || _uvs.empty();
+        for (size_t i = 0; !uvChanged && i < meshIn->st.size(); ++i) {
+            float const * uv = _uvs[i].GetUV();
+            uvChanged = (uv[0] != meshIn->st[i].s || uv[1] != meshIn->st[i].t);
         }
+        if (uvChanged)
+            interpolate_uvs(meshIn);
+    }
 
-        meshOut->f.push_back(_face);
+    if (output == kRebuild) {
+        meshOut->v.clear();
+        meshOut->st.clear();
+        meshOut->vn.clear();
+        meshOut->f.clear();
     }
 
-    delete shape;
-    shape = 0;
+    write_mesh(meshOut, uvChanged, evaluator == kThreaded);
+}
 
+void subdiv::Refiner::write_mesh(feather::FMesh *meshOut, bool uvChanged, bool threaded)
+{
+    bool hasUV = _refiner->GetNumFVarChannels() > 0;
+    bool adaptive = (_refinement == kAdaptive);
+    int nverts = _fine.size();
+
+    // The arrays are resized and written in place. Once they're the right
+    // size the resizes do nothing, the faces are only written when the
+    // topology changed and the coords when they changed, so an update
+    // that only moves the vertices doesn't allocate anything.
+    meshOut->v.resize(nverts);
+    meshOut->vn.resize(nverts);
+
+    auto vertices = [&] (int begin, int end) {
+        for (int vert = begin; vert < end; ++vert) {
+            float const * pos = _fine[vert].GetPosition();
+            float const * norm = _normals[vert].GetPosition();
+            meshOut->v[vert] = FVertex3D(pos[0],pos[1],pos[2]);
+            meshOut->vn[vert] = FVertex3D(norm[0],norm[1],norm[2]);
+        }
+    };
+    run(threaded, nverts, vertices);
+
+    // add coords, adaptive gives a tessellated vertex a coord for each
+    // ptex face it's on and uniform uses the last level's values at the end of the buffer
+    int nuvs = 0;
+    VertexUV const * uvs = nullptr;
+    if (hasUV && adaptive) {
+        nuvs = _patchUVs.size();
+        uvs = _patchUVs.data();
+    } else if (hasUV) {
+        nuvs = _refiner->GetLevel(_level).GetNumFVarValues(0);
+        uvs = _uvs.data() + _uvs.size() - nuvs;
+    }
+
+    if (uvChanged || int(meshOut->st.size()) != nuvs) {
+        meshOut->st.resize(nuvs);
+        for (int i = 0; i < nuvs; ++i)
+            meshOut->st[i] = FTextureCoord(uvs[i].GetUV()[0],uvs[i].GetUV()[1]);
+    }
+
+    // add faces
+    int nfaces = adaptive ? std::max(int(_patchFaceOffsets.size()) - 1, 0) : _refiner->GetLevel(_level).GetNumFaces();
+    if (!_rebuilt && int(meshOut->f.size()) == nfaces)
+        return;
+
+    meshOut->f.resize(nfaces);
+
+    if (adaptive) {
+        auto faces = [&] (int begin, int end) {
+            for (int face = begin; face < end; ++face) {
+                int first = _patchFaceOffsets[face];
+                FFace & _face = meshOut->f[face];
+                _face.resize(_patchFaceOffsets[face+1] - first);
+                for (int vert=0; vert<int(_face.size()); ++vert) {
+                    int index = _patchFaces[first+vert];
+                    _face[vert] = FFacePoint(index,hasUV ? _patchFaceUVs[first+vert] : 0,index);
+                }
+            }
+        };
+        run(threaded, nfaces, faces);
+        return;
+    }
+
+    OpenSubdiv::Far::TopologyLevel const & refLastLevel = _refiner->GetLevel(_level);
+
+    auto faces = [&] (int begin, int end) {
+        for (int face = begin; face < end; ++face) {
+            OpenSubdiv::Far::ConstIndexArray fverts = refLastLevel.GetFaceVertices(face);
+
+            // all refined Catmark faces are quads, level 0 keeps the input faces
+            FFace & _face = meshOut->f[face];
+            _face.resize(fverts.size());
+            if (hasUV) {
+                OpenSubdiv::Far::ConstIndexArray fuvs = refLastLevel.GetFaceFVarValues(face, 0);
+                for (int vert=0; vert<fverts.size(); ++vert) {
+                    _face[vert] = FFacePoint(fverts[vert],fuvs[vert],fverts[vert]);
+                }
+            } else {
+                for (int vert=0; vert<fverts.size(); ++vert) {
+                    _face[vert] = FFacePoint(fverts[vert],0,fverts[vert]);
+                }
+            }
+        }
+    };
+    run(threaded, nfaces, faces);
 }
 
 
+void subdiv::subdiv_mesh(
+        unsigned int maxlevel,
+        feather::FMesh *meshIn,
+        feather::FMesh *meshOut,
+        feather::FVertexIndiceGroupWeightArray *vertexWeights,
+        feather::FVertexIndiceGroupWeightArray *edgeWeights
+        )
+{
+    Refiner refiner;
+    refiner.subdiv_mesh(maxlevel,meshIn,meshOut,vertexWeights,edgeWeights);
+}
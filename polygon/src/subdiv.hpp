@@ -27,6 +27,10 @@
 #include <opensubdiv/far/topologyDescriptor.h>
 #include <opensubdiv/far/topologyRefinerFactory.h>
 #include <opensubdiv/far/primvarRefiner.h>
+#include <opensubdiv/far/stencilTable.h>
+#include <opensubdiv/far/stencilTableFactory.h>
+#include <opensubdiv/far/patchTableFactory.h>
+#include <opensubdiv/far/ptexIndices.h>
 
 namespace subdiv
 {
@@ -92,6 +96,31 @@ namespace subdiv
     };
 
 
+    // Face varying texture coord, same interface as Vertex
+    struct VertexUV {
+
+        void Clear( void * =0 ) {
+            _uv[0]=_uv[1]=0.0f;
+        }
+
+        void AddWithWeight(VertexUV const & src, float weight) {
+            _uv[0]+=weight*src._uv[0];
+            _uv[1]+=weight*src._uv[1];
+        }
+
+        void SetUV(float u, float v) {
+            _uv[0]=u;
+            _uv[1]=v;
+        }
+
+        const float * GetUV() const {
+            return _uv;
+        }
+
+        float _uv[2];
+    };
+
+
     enum Scheme {
         kBilinear=0,
         kCatmark,
@@ -101,7 +130,7 @@ namespace subdiv
 
     struct Shape {
         Shape() : scheme(kCatmark), isLeftHanded(false) { }
-        ~Shape() { tags.clear(); }
+        ~Shape() { for(auto t : tags) delete t; tags.clear(); }
 
         struct tag {
 
@@ -236,6 +265,152 @@ namespace subdiv
         }
 
 
+    // How the refined positions and limit normals are evaluated
+    enum Evaluator
+    {
+        kSerial=0,      // PrimvarRefiner on the calling thread, this is the reference
+        kThreaded       // cached stencils split across every core
+    };
+
+    enum Refinement
+    {
+        kUniform=0,     // every face is split level times
+        kAdaptive       // only faces next to extraordinary vertices and creases are split
+    };
+
+    enum Output
+    {
+        kRebuild=0,     // the output mesh is cleared and filled again
+        kInPlace        // the output arrays are kept and written over
+    };
+
+    // Hash of everything the refined topology depends on, the level, the
+    // face vertex and texture coord indices and the corner and crease
+    // weights. Positions and texture coord values are not part of it.
+    uint64_t topology_hash(
+            unsigned int maxlevel,
+            feather::FMesh *mesh,
+            feather::FVertexIndiceGroupWeightArray *vertexWeights,
+            feather::FVertexIndiceGroupWeightArray *edgeWeights
+            );
+
+    // Keeps the refiner and the stencils of the last mesh it was given.
+    // The refiner and stencils are only rebuilt when the topology hash
+    // changes, when just the positions change they are pushed through the
+    // cached stencils in a single pass.
+    //
+    // Uniform refinement outputs the faces of the last level. Adaptive
+    // refinement builds a Far::PatchTable and outputs a grid of quads on
+    // the limit surface of each patch, so the output only grows where the
+    // patches had to be isolated. Base faces get the tessellation along
+    // their sides and each level down gets half, neighbouring patches
+    // share the vertices on the edges between them so the output is one
+    // connected mesh without cracks.
+    //
+    // Texture coords are carried through the refiner as a face varying
+    // channel and output as an indexed st array.
+    //
+    // With kInPlace output the arrays of the output mesh are kept between
+    // calls, when only the positions change nothing is allocated.
+    class Refiner
+    {
+        public:
+            Refiner();
+            ~Refiner();
+
+            void subdiv_mesh(
+                    unsigned int maxlevel,
+                    feather::FMesh *meshIn,
+                    feather::FMesh *meshOut,
+                    feather::FVertexIndiceGroupWeightArray *vertexWeights,
+                    feather::FVertexIndiceGroupWeightArray *edgeWeights,
+                    Evaluator evaluator=kSerial,
+                    Refinement refinement=kUniform,
+                    unsigned int tessellation=4,
+                    Output output=kRebuild
+                    );
+
+            // true if the last subdiv_mesh() had to rebuild the topology
+            bool rebuilt() const { return _rebuilt; }
+
+        private:
+            Refiner(Refiner const &) = delete;
+            Refiner & operator=(Refiner const &) = delete;
+
+            void build(
+                    unsigned int maxlevel,
+                    feather::FMesh *meshIn,
+                    feather::FVertexIndiceGroupWeightArray *vertexWeights,
+                    feather::FVertexIndiceGroupWeightArray *edgeWeights
+                    );
+            void build_patches(OpenSubdiv::Far::PatchTable const & patches);
+            void build_tangents();
+            void clear();
+
+            void evaluate_serial();
+            void evaluate_threaded();
+            void interpolate_uvs(feather::FMesh *meshIn);
+            void write_mesh(feather::FMesh *meshOut, bool uvChanged, bool threaded);
+
+            // Limit positions and derivatives made from other vertices,
+            // laid out like a Far::LimitStencilTable. The tangents of the
+            // uniform last level only fill in the derivative weights.
+            struct LimitStencils {
+                std::vector<int> sizes;
+                std::vector<int> offsets;
+                std::vector<int> indices;
+                std::vector<float> weights;
+                std::vector<float> duWeights;
+                std::vector<float> dvWeights;
+            };
+
+            // the hash alone could match a different mesh, the counts it
+            // was built from are checked as well
+            uint64_t _hash;
+            size_t _vertexCount;
+            size_t _faceCount;
+            unsigned int _level;
+            Refinement _refinement;
+            unsigned int _tessellation;
+            bool _rebuilt;
+            OpenSubdiv::Far::TopologyRefiner *_refiner;
+            // uniform: coarse vertices to the vertices of the last level
+            // adaptive: coarse vertices to every refined vertex and the
+            // local points of the patches
+            OpenSubdiv::Far::StencilTable const *_stencils;
+            // uniform: limit derivatives of the last level, only built the
+            // first time the threaded evaluator is used
+            LimitStencils _tangents;
+            bool _hasTangents;
+            // adaptive: refined vertices to the tessellated patch vertices
+            LimitStencils _patchStencils;
+            // adaptive: the vertices and coords of the tessellated faces,
+            // a face starts at it's offset and ends at the next one. They
+            // are mostly quads, a patch of one quad next to a deeper one
+            // has the middles of those edges as well.
+            std::vector<int> _patchFaces;
+            std::vector<int> _patchFaceUVs;
+            std::vector<int> _patchFaceOffsets;
+            // adaptive: the face varying values are linear so each
+            // tessellated coord comes from the 4 corners of it's patch,
+            // 4 indices and weights for each coord
+            std::vector<int> _patchUVIndices;
+            std::vector<float> _patchUVWeights;
+            // kept between calls so they don't have to be allocated again
+            std::vector<Vertex> _coarse;
+            std::vector<Vertex> _refined;
+            std::vector<Vertex> _fine;
+            std::vector<Vertex> _limit;
+            std::vector<Vertex> _du;
+            std::vector<Vertex> _dv;
+            std::vector<Vertex> _normals;
+            // the coarse coords then every level of refined coords, these
+            // are only interpolated again when the input coords change
+            std::vector<VertexUV> _uvs;
+            std::vector<VertexUV> _patchUVs;
+    };
+
+    // one time subdivision, nothing is kept after the call
     void subdiv_mesh(
             unsigned int maxlevel,
             feather::FMesh *meshIn,